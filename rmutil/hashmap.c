@@ -0,0 +1,162 @@
+#include "hashmap.h"
+
+#define HASHMAP_MIN_CAP 4
+
+static inline uint64_t __hashmap_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t __hashmap_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t HashMap_Hash(const char *key, size_t len) {
+    const unsigned char *p = (const unsigned char *)key;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ (len * 0xC2B2AE3D27D4EB4FULL);
+    uint64_t k;
+
+    while (len >= 8) {
+        memcpy(&k, p, 8);
+        h ^= __hashmap_mix(k);
+        h = __hashmap_rotl(h, 27) * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+        p += 8;
+        len -= 8;
+    }
+    k = 0;
+    memcpy(&k, p, len);
+    h ^= __hashmap_mix(k);
+
+    return __hashmap_mix(h);
+}
+
+HashMap *NewHashMap(size_t cap) {
+    size_t c = HASHMAP_MIN_CAP;
+    while (c < cap) c *= 2;
+
+    HashMap *m = malloc(sizeof(HashMap));
+    m->buckets = calloc(c, sizeof(HashMapEntry *));
+    m->cap = c;
+    m->size = 0;
+    return m;
+}
+
+static void __hashmap_grow(HashMap *m) {
+    size_t newcap = m->cap * 2;
+    HashMapEntry **buckets = calloc(newcap, sizeof(HashMapEntry *));
+    if (buckets == NULL) return;
+
+    for (size_t i = 0; i < m->cap; i++) {
+        HashMapEntry *e = m->buckets[i];
+        while (e) {
+            HashMapEntry *next = e->next;
+            size_t b = e->hash & (newcap - 1);
+            e->next = buckets[b];
+            buckets[b] = e;
+            e = next;
+        }
+    }
+    free(m->buckets);
+    m->buckets = buckets;
+    m->cap = newcap;
+}
+
+static HashMapEntry *__hashmap_find(HashMap *m, const char *key, size_t len, uint64_t hash) {
+    HashMapEntry *e = m->buckets[hash & (m->cap - 1)];
+    while (e) {
+        if (e->hash == hash && e->keylen == len && !memcmp(e->key, key, len)) {
+            return e;
+        }
+        e = e->next;
+    }
+    return NULL;
+}
+
+HashMapEntry *HashMap_Find(HashMap *m, const char *key, size_t len) {
+    return __hashmap_find(m, key, len, HashMap_Hash(key, len));
+}
+
+void *HashMap_Get(HashMap *m, const char *key, size_t len) {
+    HashMapEntry *e = HashMap_Find(m, key, len);
+    return e ? e->value : NULL;
+}
+
+HashMapEntry *HashMap_Insert(HashMap *m, const char *key, size_t len, int *added) {
+    uint64_t hash = HashMap_Hash(key, len);
+    HashMapEntry *e = __hashmap_find(m, key, len, hash);
+    if (added) *added = (e == NULL);
+    if (e) return e;
+
+    e = malloc(sizeof(HashMapEntry) + len);
+    e->value = NULL;
+    e->hash = hash;
+    e->keylen = len;
+    memcpy(e->key, key, len);
+
+    if (m->size >= m->cap) __hashmap_grow(m);
+    size_t b = hash & (m->cap - 1);
+    e->next = m->buckets[b];
+    m->buckets[b] = e;
+    m->size++;
+    return e;
+}
+
+HashMapEntry *HashMap_Put(HashMap *m, const char *key, size_t len, void *value) {
+    HashMapEntry *e = HashMap_Insert(m, key, len, NULL);
+    e->value = value;
+    return e;
+}
+
+int HashMap_Delete(HashMap *m, const char *key, size_t len, void **value) {
+    uint64_t hash = HashMap_Hash(key, len);
+    HashMapEntry **pe = &m->buckets[hash & (m->cap - 1)];
+    while (*pe) {
+        HashMapEntry *e = *pe;
+        if (e->hash == hash && e->keylen == len && !memcmp(e->key, key, len)) {
+            *pe = e->next;
+            if (value) *value = e->value;
+            free(e);
+            m->size--;
+            return 1;
+        }
+        pe = &e->next;
+    }
+    return 0;
+}
+
+inline size_t HashMap_Size(HashMap *m) {
+    return m->size;
+}
+
+HashMapIterator HashMap_Iterate(HashMap *m) {
+    HashMapIterator it = {m, 0, NULL};
+    return it;
+}
+
+HashMapEntry *HashMapIterator_Next(HashMapIterator *it) {
+    HashMapEntry *e = it->next;
+    while (e == NULL) {
+        if (it->bucket >= it->m->cap) return NULL;
+        e = it->m->buckets[it->bucket++];
+    }
+    it->next = e->next;
+    return e;
+}
+
+void HashMap_Free(HashMap *m, void (*freeval)(void *)) {
+    for (size_t i = 0; i < m->cap; i++) {
+        HashMapEntry *e = m->buckets[i];
+        while (e) {
+            HashMapEntry *next = e->next;
+            if (freeval && e->value) freeval(e->value);
+            free(e);
+            e = next;
+        }
+    }
+    free(m->buckets);
+    free(m);
+}
@@ -0,0 +1,76 @@
+#ifndef __HASHMAP_H__
+#define __HASHMAP_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+* Generic hash map from binary safe keys to pointers, for module owned
+* indexes. Keys are copied into their entries, values are not owned.
+* Entries are allocated individually and never move, so pointers to them
+* stay valid until they are deleted.
+*/
+typedef struct HashMapEntry {
+    struct HashMapEntry *next;
+    void *value;
+    uint64_t hash;
+    size_t keylen;
+    char key[];
+} HashMapEntry;
+
+typedef struct {
+    HashMapEntry **buckets;
+    size_t cap;
+    size_t size;
+} HashMap;
+
+/* Iterator over a hash map's entries. The current entry may be deleted while
+ * iterating, but the map must not be otherwise modified. */
+typedef struct {
+    HashMap *m;
+    size_t bucket;
+    HashMapEntry *next;
+} HashMapIterator;
+
+/* Create a new hash map with room for at least cap entries. */
+HashMap *NewHashMap(size_t cap);
+
+/* Hash a binary safe buffer */
+uint64_t HashMap_Hash(const char *key, size_t len);
+
+/* Find the entry for key, or NULL if it doesn't exist */
+HashMapEntry *HashMap_Find(HashMap *m, const char *key, size_t len);
+
+/* Return the value stored for key, or NULL if it doesn't exist */
+void *HashMap_Get(HashMap *m, const char *key, size_t len);
+
+/*
+* Find the entry for key, creating it with a NULL value if it doesn't exist.
+* If added isn't NULL, it is set to 1 if the entry was created, 0 otherwise.
+*/
+HashMapEntry *HashMap_Insert(HashMap *m, const char *key, size_t len, int *added);
+
+/* Set the value stored for key, creating its entry if needed */
+HashMapEntry *HashMap_Put(HashMap *m, const char *key, size_t len, void *value);
+
+/*
+* Delete the entry for key. Returns 1 if it existed, 0 otherwise. If value
+* isn't NULL, the deleted entry's value is copied to it.
+*/
+int HashMap_Delete(HashMap *m, const char *key, size_t len, void **value);
+
+/* return the number of entries in the map */
+size_t HashMap_Size(HashMap *m);
+
+/* Start iterating over a hash map */
+HashMapIterator HashMap_Iterate(HashMap *m);
+
+/* Return the next entry, or NULL when the iteration is done */
+HashMapEntry *HashMapIterator_Next(HashMapIterator *it);
+
+/* free the hash map and its entries. If freeval isn't NULL, it is called for
+ * every non NULL value */
+void HashMap_Free(HashMap *m, void (*freeval)(void *));
+
+#endif
@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regex_util.h"
+
+int RMUtil_RegexCompile(RedisModuleCtx *ctx, regex_t *r, const char *pattern) {
+    int status = regcomp(r, pattern, REG_EXTENDED | REG_NOSUB | REG_NEWLINE);
+
+    if (status) {
+        char rerr[128];
+        char err[256];
+        regerror(status, r, rerr, sizeof(rerr));
+        snprintf(err, sizeof(err), "ERR regex compilation failed: %s", rerr);
+        RedisModule_ReplyWithError(ctx, err);
+    }
+
+    return status;
+}
+
+int RMUtil_RegexMatchBuf(regex_t *r, const char *s, size_t len, char **buf,
+                         size_t *buflen) {
+    if (len + 1 > *buflen) {
+        *buflen = len + 1;
+        *buf = realloc(*buf, *buflen);
+    }
+    memcpy(*buf, s, len);
+    (*buf)[len] = '\0';
+    return !regexec(r, *buf, 0, NULL, 0);
+}
@@ -0,0 +1,18 @@
+#ifndef __RMUTIL_REGEX_UTIL_H__
+#define __RMUTIL_REGEX_UTIL_H__
+
+#include <stddef.h>
+#include <regex.h>
+#include <redismodule.h>
+
+/* Compile a POSIX extended regex. If it fails, reply with the compilation
+ * error and return the (non zero) regcomp status */
+int RMUtil_RegexCompile(RedisModuleCtx *ctx, regex_t *r, const char *pattern);
+
+/* Return 1 if a (not null terminated) buffer matches a regex. *buf is scratch
+ * space for terminating it, of *buflen bytes, grown with realloc as needed
+ * and freed by the caller */
+int RMUtil_RegexMatchBuf(regex_t *r, const char *s, size_t len, char **buf,
+                         size_t *buflen);
+
+#endif
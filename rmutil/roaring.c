@@ -0,0 +1,418 @@
+#include "roaring.h"
+
+/*
+* The container kernels work a 64 bit word at a time on bitmaps, in plain
+* loops the compiler can vectorize.
+*/
+
+static inline int __roaring_isbitmap(const RoaringContainer *c) {
+    return c->bitmap != NULL;
+}
+
+/* Return the position of the first array value not less than v */
+static uint32_t __roaring_lowerbound(const uint16_t *a, uint32_t n, uint16_t v) {
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (a[mid] < v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Return the position of the container with key, or -(its insert position)-1
+ * if it doesn't exist */
+static long __roaring_find(const Roaring *r, uint16_t key) {
+    long lo = 0, hi = (long)r->len - 1;
+    while (lo <= hi) {
+        long mid = (lo + hi) / 2;
+        uint16_t k = r->containers[mid].key;
+        if (k == key) return mid;
+        if (k < key)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -(lo + 1);
+}
+
+static void __roaring_container_free(RoaringContainer *c) {
+    free(c->array);
+    free(c->bitmap);
+}
+
+/* Make room for a container at pos and return it, empty */
+static RoaringContainer *__roaring_insert(Roaring *r, size_t pos, uint16_t key) {
+    if (r->len == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 4;
+        r->containers = realloc(r->containers, r->cap * sizeof(RoaringContainer));
+    }
+    memmove(r->containers + pos + 1, r->containers + pos,
+            (r->len - pos) * sizeof(RoaringContainer));
+    r->len++;
+    RoaringContainer *c = r->containers + pos;
+    memset(c, 0, sizeof(RoaringContainer));
+    c->key = key;
+    return c;
+}
+
+/* Append a container, taking ownership of its data. Empty containers are
+ * freed instead */
+static void __roaring_push(Roaring *r, RoaringContainer *c) {
+    if (!c->card) {
+        __roaring_container_free(c);
+        return;
+    }
+    *__roaring_insert(r, r->len, c->key) = *c;
+}
+
+static void __roaring_tobitmap(RoaringContainer *c) {
+    c->bitmap = calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+    for (uint32_t i = 0; i < c->card; i++)
+        c->bitmap[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+    free(c->array);
+    c->array = NULL;
+    c->cap = 0;
+}
+
+/* Build a container from bitmap words with card bits set, which it takes
+ * ownership of. Sparse enough bitmaps are turned into arrays */
+static RoaringContainer __roaring_frombitmap(uint16_t key, uint64_t *words,
+                                             uint32_t card) {
+    RoaringContainer c = {.key = key, .card = card};
+    if (card > ROARING_ARRAY_MAX) {
+        c.bitmap = words;
+        return c;
+    }
+
+    c.array = malloc((card ? card : 1) * sizeof(uint16_t));
+    c.cap = card;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ROARING_BITMAP_WORDS; i++) {
+        uint64_t w = words[i];
+        while (w) {
+            c.array[n++] = (uint16_t)(i * 64 + __builtin_ctzll(w));
+            w &= w - 1;
+        }
+    }
+    free(words);
+    return c;
+}
+
+static RoaringContainer __roaring_copy(const RoaringContainer *c) {
+    RoaringContainer d = *c;
+    if (__roaring_isbitmap(c)) {
+        d.bitmap = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        memcpy(d.bitmap, c->bitmap, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    } else {
+        d.cap = c->card;
+        d.array = malloc((c->card ? c->card : 1) * sizeof(uint16_t));
+        memcpy(d.array, c->array, c->card * sizeof(uint16_t));
+    }
+    return d;
+}
+
+static inline int __roaring_bitmap_has(const uint64_t *words, uint16_t v) {
+    return (words[v >> 6] >> (v & 63)) & 1;
+}
+
+Roaring *NewRoaring() {
+    return calloc(1, sizeof(Roaring));
+}
+
+void Roaring_Free(Roaring *r) {
+    for (size_t i = 0; i < r->len; i++) __roaring_container_free(r->containers + i);
+    free(r->containers);
+    free(r);
+}
+
+Roaring *Roaring_Copy(const Roaring *r) {
+    Roaring *c = NewRoaring();
+    for (size_t i = 0; i < r->len; i++) {
+        RoaringContainer d = __roaring_copy(r->containers + i);
+        __roaring_push(c, &d);
+    }
+    return c;
+}
+
+int Roaring_Add(Roaring *r, uint32_t x) {
+    uint16_t key = x >> 16, low = x & 0xffff;
+    long pos = __roaring_find(r, key);
+    RoaringContainer *c =
+        pos >= 0 ? r->containers + pos : __roaring_insert(r, -pos - 1, key);
+
+    if (!__roaring_isbitmap(c)) {
+        uint32_t i = __roaring_lowerbound(c->array, c->card, low);
+        if (i < c->card && c->array[i] == low) return 0;
+        if (c->card < ROARING_ARRAY_MAX) {
+            if (c->card == c->cap) {
+                c->cap = c->cap ? c->cap * 2 : 4;
+                if (c->cap > ROARING_ARRAY_MAX) c->cap = ROARING_ARRAY_MAX;
+                c->array = realloc(c->array, c->cap * sizeof(uint16_t));
+            }
+            memmove(c->array + i + 1, c->array + i, (c->card - i) * sizeof(uint16_t));
+            c->array[i] = low;
+            c->card++;
+            return 1;
+        }
+        __roaring_tobitmap(c);
+    }
+
+    if (__roaring_bitmap_has(c->bitmap, low)) return 0;
+    c->bitmap[low >> 6] |= 1ULL << (low & 63);
+    c->card++;
+    return 1;
+}
+
+int Roaring_Contains(const Roaring *r, uint32_t x) {
+    uint16_t low = x & 0xffff;
+    long pos = __roaring_find(r, x >> 16);
+    if (pos < 0) return 0;
+
+    const RoaringContainer *c = r->containers + pos;
+    if (__roaring_isbitmap(c)) return __roaring_bitmap_has(c->bitmap, low);
+    uint32_t i = __roaring_lowerbound(c->array, c->card, low);
+    return i < c->card && c->array[i] == low;
+}
+
+uint64_t Roaring_Card(const Roaring *r) {
+    uint64_t card = 0;
+    for (size_t i = 0; i < r->len; i++) card += r->containers[i].card;
+    return card;
+}
+
+size_t Roaring_MemUsage(const Roaring *r) {
+    size_t size = sizeof(Roaring) + r->cap * sizeof(RoaringContainer);
+    for (size_t i = 0; i < r->len; i++) {
+        const RoaringContainer *c = r->containers + i;
+        size += __roaring_isbitmap(c) ? ROARING_BITMAP_WORDS * sizeof(uint64_t)
+                                      : c->cap * sizeof(uint16_t);
+    }
+    return size;
+}
+
+static RoaringContainer __roaring_and(const RoaringContainer *a,
+                                      const RoaringContainer *b) {
+    RoaringContainer c = {.key = a->key};
+    if (__roaring_isbitmap(a) && __roaring_isbitmap(b)) {
+        uint64_t *words = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        uint32_t card = 0;
+        for (int i = 0; i < ROARING_BITMAP_WORDS; i++) {
+            words[i] = a->bitmap[i] & b->bitmap[i];
+            card += __builtin_popcountll(words[i]);
+        }
+        return __roaring_frombitmap(a->key, words, card);
+    }
+
+    /* At least one is an array, which bounds the result */
+    if (__roaring_isbitmap(a)) {
+        const RoaringContainer *t = a;
+        a = b;
+        b = t;
+    }
+    c.array = malloc((a->card ? a->card : 1) * sizeof(uint16_t));
+    c.cap = a->card;
+    if (__roaring_isbitmap(b)) {
+        for (uint32_t i = 0; i < a->card; i++)
+            if (__roaring_bitmap_has(b->bitmap, a->array[i]))
+                c.array[c.card++] = a->array[i];
+    } else {
+        uint32_t i = 0, j = 0;
+        while (i < a->card && j < b->card) {
+            if (a->array[i] < b->array[j])
+                i++;
+            else if (a->array[i] > b->array[j])
+                j++;
+            else {
+                c.array[c.card++] = a->array[i];
+                i++;
+                j++;
+            }
+        }
+    }
+    return c;
+}
+
+static RoaringContainer __roaring_or(const RoaringContainer *a,
+                                     const RoaringContainer *b) {
+    if (!__roaring_isbitmap(a) && !__roaring_isbitmap(b)) {
+        RoaringContainer c = {.key = a->key};
+        c.cap = a->card + b->card;
+        c.array = malloc(c.cap * sizeof(uint16_t));
+        uint32_t i = 0, j = 0;
+        while (i < a->card || j < b->card) {
+            if (j == b->card || (i < a->card && a->array[i] < b->array[j]))
+                c.array[c.card++] = a->array[i++];
+            else if (i == a->card || b->array[j] < a->array[i])
+                c.array[c.card++] = b->array[j++];
+            else {
+                c.array[c.card++] = a->array[i++];
+                j++;
+            }
+        }
+        if (c.card > ROARING_ARRAY_MAX) __roaring_tobitmap(&c);
+        return c;
+    }
+
+    /* At least one is a bitmap, and so is the result */
+    if (!__roaring_isbitmap(a)) {
+        const RoaringContainer *t = a;
+        a = b;
+        b = t;
+    }
+    RoaringContainer c = __roaring_copy(a);
+    if (__roaring_isbitmap(b)) {
+        c.card = 0;
+        for (int i = 0; i < ROARING_BITMAP_WORDS; i++) {
+            c.bitmap[i] |= b->bitmap[i];
+            c.card += __builtin_popcountll(c.bitmap[i]);
+        }
+    } else {
+        for (uint32_t i = 0; i < b->card; i++) {
+            uint16_t v = b->array[i];
+            c.card += !__roaring_bitmap_has(c.bitmap, v);
+            c.bitmap[v >> 6] |= 1ULL << (v & 63);
+        }
+    }
+    return c;
+}
+
+static RoaringContainer __roaring_andnot(const RoaringContainer *a,
+                                         const RoaringContainer *b) {
+    if (__roaring_isbitmap(a)) {
+        uint64_t *words = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        uint32_t card = 0;
+        if (__roaring_isbitmap(b)) {
+            for (int i = 0; i < ROARING_BITMAP_WORDS; i++) {
+                words[i] = a->bitmap[i] & ~b->bitmap[i];
+                card += __builtin_popcountll(words[i]);
+            }
+        } else {
+            memcpy(words, a->bitmap, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+            card = a->card;
+            for (uint32_t i = 0; i < b->card; i++) {
+                uint16_t v = b->array[i];
+                card -= __roaring_bitmap_has(words, v);
+                words[v >> 6] &= ~(1ULL << (v & 63));
+            }
+        }
+        return __roaring_frombitmap(a->key, words, card);
+    }
+
+    RoaringContainer c = {.key = a->key};
+    c.array = malloc((a->card ? a->card : 1) * sizeof(uint16_t));
+    c.cap = a->card;
+    if (__roaring_isbitmap(b)) {
+        for (uint32_t i = 0; i < a->card; i++)
+            if (!__roaring_bitmap_has(b->bitmap, a->array[i]))
+                c.array[c.card++] = a->array[i];
+    } else {
+        uint32_t i = 0, j = 0;
+        while (i < a->card) {
+            if (j == b->card || a->array[i] < b->array[j])
+                c.array[c.card++] = a->array[i++];
+            else if (a->array[i] > b->array[j])
+                j++;
+            else {
+                i++;
+                j++;
+            }
+        }
+    }
+    return c;
+}
+
+Roaring *Roaring_And(const Roaring *a, const Roaring *b) {
+    Roaring *r = NewRoaring();
+    size_t i = 0, j = 0;
+    while (i < a->len && j < b->len) {
+        const RoaringContainer *ca = a->containers + i, *cb = b->containers + j;
+        if (ca->key < cb->key)
+            i++;
+        else if (ca->key > cb->key)
+            j++;
+        else {
+            RoaringContainer c = __roaring_and(ca, cb);
+            __roaring_push(r, &c);
+            i++;
+            j++;
+        }
+    }
+    return r;
+}
+
+Roaring *Roaring_Or(const Roaring *a, const Roaring *b) {
+    Roaring *r = NewRoaring();
+    size_t i = 0, j = 0;
+    while (i < a->len || j < b->len) {
+        const RoaringContainer *ca = i < a->len ? a->containers + i : NULL;
+        const RoaringContainer *cb = j < b->len ? b->containers + j : NULL;
+        RoaringContainer c;
+        if (!cb || (ca && ca->key < cb->key)) {
+            c = __roaring_copy(ca);
+            i++;
+        } else if (!ca || cb->key < ca->key) {
+            c = __roaring_copy(cb);
+            j++;
+        } else {
+            c = __roaring_or(ca, cb);
+            i++;
+            j++;
+        }
+        __roaring_push(r, &c);
+    }
+    return r;
+}
+
+Roaring *Roaring_AndNot(const Roaring *a, const Roaring *b) {
+    Roaring *r = NewRoaring();
+    size_t i = 0, j = 0;
+    while (i < a->len) {
+        const RoaringContainer *ca = a->containers + i;
+        RoaringContainer c;
+        if (j < b->len && b->containers[j].key < ca->key) {
+            j++;
+            continue;
+        }
+        if (j < b->len && b->containers[j].key == ca->key)
+            c = __roaring_andnot(ca, b->containers + j++);
+        else
+            c = __roaring_copy(ca);
+        __roaring_push(r, &c);
+        i++;
+    }
+    return r;
+}
+
+void Roaring_AppendContainer(Roaring *r, uint16_t key, uint32_t card,
+                             const void *data) {
+    RoaringContainer c = {.key = key, .card = card};
+    if (card > ROARING_ARRAY_MAX) {
+        c.bitmap = malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        memcpy(c.bitmap, data, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    } else {
+        c.cap = card;
+        c.array = malloc((card ? card : 1) * sizeof(uint16_t));
+        memcpy(c.array, data, card * sizeof(uint16_t));
+    }
+    __roaring_push(r, &c);
+}
+
+void RoaringContainer_Values(const RoaringContainer *c, uint32_t *out) {
+    uint32_t high = (uint32_t)c->key << 16;
+    if (!__roaring_isbitmap(c)) {
+        for (uint32_t i = 0; i < c->card; i++) out[i] = high | c->array[i];
+        return;
+    }
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ROARING_BITMAP_WORDS; i++) {
+        uint64_t w = c->bitmap[i];
+        while (w) {
+            out[n++] = high | (i * 64 + __builtin_ctzll(w));
+            w &= w - 1;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef __ROARING_H__
+#define __ROARING_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Containers holding up to this many values are sorted arrays, larger ones
+ * are bitmaps. */
+#define ROARING_ARRAY_MAX 4096
+#define ROARING_BITMAP_WORDS 1024
+
+/*
+* A container of the values that share their upper 16 bits. Sparse containers
+* are sorted arrays of the lower 16 bits, dense ones are 65536 bit bitmaps.
+*/
+typedef struct {
+    uint16_t key;
+    uint32_t card;
+    uint32_t cap;      /* array capacity, 0 for bitmaps */
+    uint16_t *array;   /* NULL for bitmaps */
+    uint64_t *bitmap;  /* NULL for arrays */
+} RoaringContainer;
+
+/*
+* A compressed bitmap of 32 bit integers, with its containers sorted by key.
+*/
+typedef struct {
+    RoaringContainer *containers;
+    size_t len;
+    size_t cap;
+} Roaring;
+
+/* Create a new empty bitmap */
+Roaring *NewRoaring();
+
+/* Free a bitmap and its containers */
+void Roaring_Free(Roaring *r);
+
+/* Return a copy of a bitmap */
+Roaring *Roaring_Copy(const Roaring *r);
+
+/* Add a value. Returns 1 if it was added, 0 if it was already there */
+int Roaring_Add(Roaring *r, uint32_t x);
+
+/* Return 1 if the bitmap contains the value, 0 otherwise */
+int Roaring_Contains(const Roaring *r, uint32_t x);
+
+/* Return the number of values in the bitmap */
+uint64_t Roaring_Card(const Roaring *r);
+
+/* Return the number of bytes the bitmap uses */
+size_t Roaring_MemUsage(const Roaring *r);
+
+/* Return new bitmaps of the intersection, union and difference of a and b */
+Roaring *Roaring_And(const Roaring *a, const Roaring *b);
+Roaring *Roaring_Or(const Roaring *a, const Roaring *b);
+Roaring *Roaring_AndNot(const Roaring *a, const Roaring *b);
+
+/*
+* Append a container, whose key must be greater than the last one's. data is
+* an array of card lower 16 bits if card <= ROARING_ARRAY_MAX, or
+* ROARING_BITMAP_WORDS bitmap words otherwise, and is copied.
+*/
+void Roaring_AppendContainer(Roaring *r, uint16_t key, uint32_t card,
+                             const void *data);
+
+/* Write a container's values, in order, to out, which must have room for
+ * c->card values */
+void RoaringContainer_Values(const RoaringContainer *c, uint32_t *out);
+
+#endif
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include "hashmap.h"
+#include "assert.h"
+
+int main(int argc, char **argv) {
+    HashMap *m = NewHashMap(0);
+    assert(0 == HashMap_Size(m));
+
+    char key[32];
+    for (int i = 0; i < 1000; i++) {
+        int n = sprintf(key, "key:%d", i);
+        int added;
+        HashMapEntry *e = HashMap_Insert(m, key, n, &added);
+        assert(1 == added);
+        e->value = (void *)(long)(i + 1);
+    }
+    assert(1000 == HashMap_Size(m));
+
+    int added;
+    HashMap_Insert(m, "key:42", 6, &added);
+    assert(0 == added);
+    assert(43 == (long)HashMap_Get(m, "key:42", 6));
+    assert(NULL == HashMap_Get(m, "key:1000", 8));
+
+    void *val;
+    assert(1 == HashMap_Delete(m, "key:42", 6, &val));
+    assert(43 == (long)val);
+    assert(0 == HashMap_Delete(m, "key:42", 6, NULL));
+    assert(999 == HashMap_Size(m));
+
+    // delete everything while iterating
+    HashMapIterator it = HashMap_Iterate(m);
+    HashMapEntry *e;
+    int n = 0;
+    while ((e = HashMapIterator_Next(&it)) != NULL) {
+        assert(1 == HashMap_Delete(m, e->key, e->keylen, NULL));
+        n++;
+    }
+    assert(999 == n);
+    assert(0 == HashMap_Size(m));
+
+    HashMap_Put(m, "", 0, "empty");
+    assert(!strcmp("empty", HashMap_Get(m, "", 0)));
+
+    HashMap_Free(m, NULL);
+    printf("PASS!");
+    return 0;
+}
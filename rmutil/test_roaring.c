@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include "roaring.h"
+#include "assert.h"
+
+#define UNIVERSE (4 * 65536)
+
+/* Fill a bitmap and its reference with values of varying density, so that
+ * both array and bitmap containers are exercised. */
+Roaring *fill(char *ref, int seed) {
+    Roaring *r = NewRoaring();
+    memset(ref, 0, UNIVERSE);
+    srand(seed);
+    for (int key = 0; key < 4; key++) {
+        int n = (rand() % 3 == 0) ? 20000 : rand() % 3000;
+        for (int i = 0; i < n; i++) {
+            uint32_t x = key * 65536 + rand() % 65536;
+            assert(Roaring_Add(r, x) == !ref[x]);
+            ref[x] = 1;
+        }
+    }
+    return r;
+}
+
+void check(Roaring *r, const char *ref) {
+    uint64_t card = 0;
+    for (uint32_t x = 0; x < UNIVERSE; x++) {
+        assert(Roaring_Contains(r, x) == ref[x]);
+        card += ref[x];
+    }
+    assert(Roaring_Card(r) == card);
+
+    uint32_t *values = malloc(65536 * sizeof(uint32_t));
+    uint32_t last = 0;
+    int first = 1;
+    for (size_t i = 0; i < r->len; i++) {
+        RoaringContainer *c = r->containers + i;
+        assert(c->card > 0);
+        assert((c->bitmap != NULL) == (c->card > ROARING_ARRAY_MAX));
+        RoaringContainer_Values(c, values);
+        for (uint32_t j = 0; j < c->card; j++) {
+            assert(ref[values[j]]);
+            assert(first || values[j] > last);
+            last = values[j];
+            first = 0;
+        }
+    }
+    free(values);
+}
+
+int main(int argc, char **argv) {
+    char *ra = malloc(UNIVERSE), *rb = malloc(UNIVERSE), *rc = malloc(UNIVERSE);
+
+    Roaring *e = NewRoaring();
+    assert(0 == Roaring_Card(e));
+    assert(0 == Roaring_Contains(e, 42));
+    assert(1 == Roaring_Add(e, 0xffffffff));
+    assert(0 == Roaring_Add(e, 0xffffffff));
+    assert(1 == Roaring_Contains(e, 0xffffffff));
+    Roaring_Free(e);
+
+    for (int seed = 0; seed < 20; seed++) {
+        Roaring *a = fill(ra, seed * 2), *b = fill(rb, seed * 2 + 1);
+        check(a, ra);
+        check(b, rb);
+
+        Roaring *c = Roaring_And(a, b);
+        for (int x = 0; x < UNIVERSE; x++) rc[x] = ra[x] && rb[x];
+        check(c, rc);
+        Roaring_Free(c);
+
+        c = Roaring_Or(a, b);
+        for (int x = 0; x < UNIVERSE; x++) rc[x] = ra[x] || rb[x];
+        check(c, rc);
+        Roaring_Free(c);
+
+        c = Roaring_Copy(a);
+        check(c, ra);
+        Roaring_Free(c);
+
+        c = Roaring_AndNot(a, b);
+        for (int x = 0; x < UNIVERSE; x++) rc[x] = ra[x] && !rb[x];
+        check(c, rc);
+
+        // rebuild from containers
+        Roaring *d = NewRoaring();
+        for (size_t i = 0; i < c->len; i++) {
+            RoaringContainer *ct = c->containers + i;
+            Roaring_AppendContainer(d, ct->key, ct->card,
+                                    ct->bitmap ? (void *)ct->bitmap : (void *)ct->array);
+        }
+        check(d, rc);
+        Roaring_Free(d);
+        Roaring_Free(c);
+
+        Roaring_Free(a);
+        Roaring_Free(b);
+    }
+
+    free(ra);
+    free(rb);
+    free(rc);
+    printf("PASS!\n");
+    return 0;
+}
@@ -2,6 +2,7 @@
 #define __TEST_UTIL_H__
 
 #include "util.h"
+#include "strings.h"
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -220,4 +220,16 @@ RedisModuleCallReply *RedisModule_CallReplyArrayElementByPath(
   } while ((ele != NULL) && (*e != '\0'));
 
   return ele;
-}
\ No newline at end of file
+}
+
+RedisModuleKey *RMUtil_OpenModuleKey(RedisModuleCtx *ctx,
+                                     RedisModuleString *keyname, int mode,
+                                     RedisModuleType *mt) {
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, mode);
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY &&
+      RedisModule_ModuleTypeGetType(key) != mt) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return NULL;
+  }
+  return key;
+}
@@ -102,5 +102,14 @@ int RMUtilInfo_GetDouble(RMUtilInfo *info, const char *key, double *d);
 RedisModuleCallReply *RedisModule_CallReplyArrayElementByPath(
     RedisModuleCallReply *rep, const char *path);
 
+/*
+* Opens a key that is either empty or holds a value of the module type mt.
+* If it holds anything else, replies with a WRONGTYPE error and returns NULL.
+* The key's value is then RedisModule_ModuleTypeGetValue's, NULL if empty.
+*/
+RedisModuleKey *RMUtil_OpenModuleKey(RedisModuleCtx *ctx,
+                                     RedisModuleString *keyname, int mode,
+                                     RedisModuleType *mt);
+
 
 #endif
@@ -15,9 +15,22 @@
 * You should have received a copy of the GNU Affero General Public License
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include "../redismodule.h"
 #include "../rmutil/util.h"
 #include "../rmutil/strings.h"
+#include "../rmutil/vector.h"
+#include "../rmutil/hashmap.h"
+#include "../rmutil/regex_util.h"
 #include "../rmutil/test_util.h"
 
 #define RM_MODULE_NAME "rxhashes"
@@ -58,6 +71,1236 @@ int HGetSetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   return REDISMODULE_OK;
 }
 
+/*
+* HMGETSET key field value [field value ...]
+* Sets multiple fields in Hash 'key' and returns their previous values. The
+* key is opened once for all fields.
+* Reply: Array of Strings, the previous values or NULL for fields that didn't
+* exist.
+*/
+int HMGetSetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if ((argc < 4) || (argc % 2 != 0)) {
+    return RedisModule_WrongArity(ctx);
+  }
+  RedisModule_AutoMemory(ctx);
+
+  // open the key and make sure it is indeed a Hash and not empty
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+
+  if ((RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) &&
+      (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_HASH)) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  // swap the fields in argument order, so repeated fields see earlier sets
+  int i;
+  RedisModule_ReplyWithArray(ctx, (argc - 2) / 2);
+  for (i = 2; i < argc; i += 2) {
+    RedisModuleString *val;
+    RedisModule_HashGet(key, REDISMODULE_HASH_NONE, argv[i], &val, NULL);
+    RedisModule_HashSet(key, REDISMODULE_HASH_NONE, argv[i], argv[i + 1],
+                        NULL);
+
+    if (!val)
+      RedisModule_ReplyWithNull(ctx);
+    else
+      RedisModule_ReplyWithString(ctx, val);
+  }
+
+  return REDISMODULE_OK;
+}
+
+/*
+* MHGETSET field value key [key ...]
+* Sets the same 'field' to 'value' in multiple Hashes and returns the
+* previous values.
+* Reply: Array of Strings, the previous values or NULL where 'field' didn't
+* exist.
+*/
+int MHGetSetCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 4) {
+    return RedisModule_WrongArity(ctx);
+  }
+  RedisModule_AutoMemory(ctx);
+
+  /* Make sure all keys are Hashes or empty before changing any of them. */
+  int i, numkeys = argc - 3;
+  RedisModuleKey **keys = RedisModule_PoolAlloc(ctx, numkeys * sizeof(*keys));
+  for (i = 0; i < numkeys; i++) {
+    keys[i] = RedisModule_OpenKey(ctx, argv[3 + i],
+                                  REDISMODULE_READ | REDISMODULE_WRITE);
+    if ((RedisModule_KeyType(keys[i]) != REDISMODULE_KEYTYPE_EMPTY) &&
+        (RedisModule_KeyType(keys[i]) != REDISMODULE_KEYTYPE_HASH)) {
+      RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+      return REDISMODULE_ERR;
+    }
+  }
+
+  RedisModule_ReplyWithArray(ctx, numkeys);
+  for (i = 0; i < numkeys; i++) {
+    RedisModuleString *val;
+    RedisModule_HashGet(keys[i], REDISMODULE_HASH_NONE, argv[1], &val, NULL);
+    RedisModule_HashSet(keys[i], REDISMODULE_HASH_NONE, argv[1], argv[2],
+                        NULL);
+
+    if (!val)
+      RedisModule_ReplyWithNull(ctx);
+    else
+      RedisModule_ReplyWithString(ctx, val);
+  }
+
+  return REDISMODULE_OK;
+}
+
+/* Helper function: checks if incrementing 'cur' by 'incr' would overflow. */
+int incr_overflows(long long cur, long long incr) {
+  return ((incr < 0 && cur < 0 && incr < LLONG_MIN - cur) ||
+          (incr > 0 && cur > 0 && incr > LLONG_MAX - cur));
+}
+
+/*
+* HCHECKAND key field expected [field expected ...] THEN <command> [arg ...]
+* Checks that every 'field' in Hash 'key' equals its 'expected' value and
+* only then executes a Hash command on it. The command can be any of:
+*   HSET field value [field value ...]
+*   HINCRBY field increment
+*   HDEL field [field ...]
+* Note: the key shouldn't be repeated for the executed command.
+* Reply: NULL if any check fails, otherwise the reply of the command.
+*/
+int HCheckAndCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                     int argc) {
+  if (argc < 7) {
+    return RedisModule_WrongArity(ctx);
+  }
+  RedisModule_AutoMemory(ctx);
+
+  /* Locate the THEN separating the checks from the command. */
+  int i, then = 0;
+  for (i = 2; i < argc - 1; i += 2) {
+    if (!strcasecmp("then", RedisModule_StringPtrLen(argv[i], NULL))) {
+      then = i;
+      break;
+    }
+  }
+  if (then < 4) {
+    RedisModule_ReplyWithError(ctx, "ERR syntax error");
+    return REDISMODULE_ERR;
+  }
+
+  /* Validate the target command's arguments. */
+  const char *cmd = RedisModule_StringPtrLen(argv[then + 1], NULL);
+  int cmdidx = then + 2, cmdargc = argc - cmdidx;
+  if (!strcasecmp("hset", cmd)) {
+    if (cmdargc < 2 || cmdargc % 2 != 0) goto arity;
+  } else if (!strcasecmp("hincrby", cmd)) {
+    if (cmdargc != 2) goto arity;
+  } else if (!strcasecmp("hdel", cmd)) {
+    if (cmdargc < 1) goto arity;
+  } else {
+    RedisModule_ReplyWithError(ctx, "ERR invalid target command");
+    return REDISMODULE_ERR;
+  }
+
+  // open the key and make sure it is indeed a Hash and not empty
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+
+  if ((RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) &&
+      (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_HASH)) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  /* Check the fields, a missing field never equals. */
+  for (i = 2; i < then; i += 2) {
+    RedisModuleString *val;
+    RedisModule_HashGet(key, REDISMODULE_HASH_NONE, argv[i], &val, NULL);
+    if (!val || RMUtil_StringEquals(val, argv[i + 1]) == 0) {
+      RedisModule_ReplyWithNull(ctx);
+      return REDISMODULE_OK;
+    }
+  }
+
+  /* Execute the command. */
+  long long count = 0;
+  if (!strcasecmp("hset", cmd)) {
+    for (i = cmdidx; i < argc; i += 2) {
+      int exists;
+      RedisModule_HashGet(key, REDISMODULE_HASH_EXISTS, argv[i], &exists,
+                          NULL);
+      RedisModule_HashSet(key, REDISMODULE_HASH_NONE, argv[i], argv[i + 1],
+                          NULL);
+      count += !exists;
+    }
+  } else if (!strcasecmp("hincrby", cmd)) {
+    long long incr, cur = 0;
+    if (RedisModule_StringToLongLong(argv[cmdidx + 1], &incr) !=
+        REDISMODULE_OK) {
+      RedisModule_ReplyWithError(ctx,
+                                 "ERR value is not an integer or out of range");
+      return REDISMODULE_ERR;
+    }
+    RedisModuleString *val;
+    RedisModule_HashGet(key, REDISMODULE_HASH_NONE, argv[cmdidx], &val, NULL);
+    if (val && RedisModule_StringToLongLong(val, &cur) != REDISMODULE_OK) {
+      RedisModule_ReplyWithError(ctx, "ERR hash value is not an integer");
+      return REDISMODULE_ERR;
+    }
+    if (incr_overflows(cur, incr)) {
+      RedisModule_ReplyWithError(ctx,
+                                 "ERR increment or decrement would overflow");
+      return REDISMODULE_ERR;
+    }
+    count = cur + incr;
+    RedisModule_HashSet(key, REDISMODULE_HASH_NONE, argv[cmdidx],
+                        RedisModule_CreateStringFromLongLong(ctx, count),
+                        NULL);
+  } else {
+    for (i = cmdidx; i < argc; i++)
+      count += RedisModule_HashSet(key, REDISMODULE_HASH_NONE, argv[i],
+                                   REDISMODULE_HASH_DELETE, NULL);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, count);
+  return REDISMODULE_OK;
+
+arity:
+  RedisModule_ReplyWithError(
+      ctx, "ERR wrong number of arguments for target command");
+  return REDISMODULE_ERR;
+}
+
+/*
+* HMGETMULTI numfields field [field ...] key [key ...]
+* Gets the same fields from multiple Hashes.
+* Reply: Array of Arrays, the values of the fields for each key in order, with
+* NULL for fields (or keys) that don't exist.
+*/
+int HMGetMultiCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
+  long long numfields;
+  if ((argc < 4) ||
+      (RedisModule_StringToLongLong(argv[1], &numfields) != REDISMODULE_OK) ||
+      (numfields < 1) || (numfields > argc - 3)) {
+    if (RedisModule_IsKeysPositionRequest(ctx))
+      /* TODO: handle this once the getkey-api allows signalling errors */
+      return REDISMODULE_OK;
+    else if (argc < 4)
+      return RedisModule_WrongArity(ctx);
+    RedisModule_ReplyWithError(ctx, "ERR invalid numfields");
+    return REDISMODULE_ERR;
+  }
+
+  int i, j, ikey = 2 + numfields;
+  if (RedisModule_IsKeysPositionRequest(ctx)) {
+    for (i = ikey; i < argc; i++) RedisModule_KeyAtPos(ctx, i);
+    return REDISMODULE_OK;
+  }
+
+  RedisModule_AutoMemory(ctx);
+
+  /* Open every key once, making sure they're all Hashes or empty. */
+  int numkeys = argc - ikey;
+  RedisModuleKey **keys = RedisModule_PoolAlloc(ctx, numkeys * sizeof(*keys));
+  for (i = 0; i < numkeys; i++) {
+    keys[i] = RedisModule_OpenKey(ctx, argv[ikey + i], REDISMODULE_READ);
+    if ((RedisModule_KeyType(keys[i]) != REDISMODULE_KEYTYPE_EMPTY) &&
+        (RedisModule_KeyType(keys[i]) != REDISMODULE_KEYTYPE_HASH)) {
+      RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+      return REDISMODULE_ERR;
+    }
+  }
+
+  RedisModule_ReplyWithArray(ctx, numkeys);
+  for (i = 0; i < numkeys; i++) {
+    RedisModule_ReplyWithArray(ctx, numfields);
+    for (j = 0; j < numfields; j++) {
+      RedisModuleString *val = NULL;
+      if (RedisModule_KeyType(keys[i]) == REDISMODULE_KEYTYPE_HASH)
+        RedisModule_HashGet(keys[i], REDISMODULE_HASH_NONE, argv[2 + j], &val,
+                            NULL);
+
+      if (!val) {
+        RedisModule_ReplyWithNull(ctx);
+      } else {
+        RedisModule_ReplyWithString(ctx, val);
+        RedisModule_FreeString(ctx, val);
+      }
+    }
+    RedisModule_CloseKey(keys[i]);
+  }
+
+  return REDISMODULE_OK;
+}
+
+/* Helper function: returns a monotonic clock in microseconds. */
+static long long hashes_ustime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+* HPSCAN key cursor pattern [COUNT n] [VALUES] [BUDGET usec]
+* Incrementally iterates a Hash like HSCAN, returning only the fields whose
+* names match 'pattern' (a POSIX Extended Regular Expression). 'COUNT' is
+* passed to every HSCAN step, 'VALUES' adds the fields' values to the reply,
+* and 'BUDGET' keeps scanning until 'usec' microseconds have elapsed or the
+* iteration is complete (by default a single step is performed).
+* Reply: Array, the next cursor and an array of the matching fields
+* (optionally followed by their values).
+*/
+int HPScanCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if ((argc < 4) || (argc > 9)) {
+    return RedisModule_WrongArity(ctx);
+  }
+  RedisModule_AutoMemory(ctx);
+
+  /* Parse subcommands. */
+  long long count = 10, budget = 0;
+  int i, withvalues = 0;
+  for (i = 4; i < argc; i++) {
+    const char *subcmd = RedisModule_StringPtrLen(argv[i], NULL);
+    if (!strcasecmp("values", subcmd)) {
+      withvalues = 1;
+    } else if (!strcasecmp("count", subcmd) && i + 1 < argc) {
+      if ((RedisModule_StringToLongLong(argv[++i], &count) !=
+           REDISMODULE_OK) ||
+          (count < 1)) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid count");
+        return REDISMODULE_ERR;
+      }
+    } else if (!strcasecmp("budget", subcmd) && i + 1 < argc) {
+      if ((RedisModule_StringToLongLong(argv[++i], &budget) !=
+           REDISMODULE_OK) ||
+          (budget < 0)) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid budget");
+        return REDISMODULE_ERR;
+      }
+    } else {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
+    }
+  }
+
+  long long lcursor;
+  if ((RedisModule_StringToLongLong(argv[2], &lcursor) != REDISMODULE_OK) ||
+      (lcursor < 0)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid cursor");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if ((RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) &&
+      (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_HASH)) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  /* Compile a regex from the pattern. */
+  regex_t regex;
+  const char *pat = RedisModule_StringPtrLen(argv[3], NULL);
+  if (RMUtil_RegexCompile(ctx, &regex, pat)) return REDISMODULE_ERR;
+
+  /* Scan the hash, keeping the replies until the cursor is known. */
+  Vector *matches = NewVector(RedisModuleCallReply *, 16);
+  RedisModuleString *scursor = argv[2];
+  char *buf = NULL;
+  size_t buflen = 0;
+  long long start = hashes_ustime();
+  do {
+    RedisModuleCallReply *rep =
+        RedisModule_Call(ctx, "HSCAN", "sscl", argv[1], scursor, "COUNT", count);
+    if (rep == NULL ||
+        RedisModule_CallReplyType(rep) != REDISMODULE_REPLY_ARRAY) {
+      if (rep == NULL)
+        RedisModule_ReplyWithError(ctx, "ERR reply is NULL");
+      else
+        RedisModule_ReplyWithCallReply(ctx, rep);
+      Vector_Free(matches);
+      regfree(&regex);
+      free(buf);
+      return REDISMODULE_ERR;
+    }
+
+    /* Get the current cursor. */
+    scursor = RedisModule_CreateStringFromCallReply(
+        RedisModule_CallReplyArrayElement(rep, 0));
+    RedisModule_StringToLongLong(scursor, &lcursor);
+
+    /* Filter fields by pattern matching. */
+    RedisModuleCallReply *rfields = RedisModule_CallReplyArrayElement(rep, 1);
+    size_t len = RedisModule_CallReplyLength(rfields);
+    size_t j;
+    for (j = 0; j + 1 < len; j += 2) {
+      RedisModuleCallReply *rfield =
+          RedisModule_CallReplyArrayElement(rfields, j);
+      size_t flen;
+      const char *field = RedisModule_CallReplyStringPtr(rfield, &flen);
+      if (!RMUtil_RegexMatchBuf(&regex, field, flen, &buf, &buflen))
+        continue;
+      Vector_Push(matches, rfield);
+      if (withvalues)
+        Vector_Push(matches, RedisModule_CallReplyArrayElement(rfields, j + 1));
+    }
+  } while (lcursor && budget && hashes_ustime() - start < budget);
+
+  /* Reply with the cursor and the matches. */
+  size_t nmatches = Vector_Size(matches);
+  RedisModule_ReplyWithArray(ctx, 2);
+  RedisModule_ReplyWithString(ctx, scursor);
+  RedisModule_ReplyWithArray(ctx, nmatches);
+  for (i = 0; i < nmatches; i++) {
+    RedisModuleCallReply *rmatch;
+    Vector_Get(matches, i, &rmatch);
+    size_t mlen;
+    const char *match = RedisModule_CallReplyStringPtr(rmatch, &mlen);
+    RedisModule_ReplyWithStringBuffer(ctx, match, mlen);
+  }
+
+  Vector_Free(matches);
+  regfree(&regex);
+  free(buf);
+  return REDISMODULE_OK;
+}
+
+/*
+* HMINCRBY key field increment [field increment ...]
+* A variadic variant for HINCRBY, increments multiple fields in Hash 'key'.
+* Nothing is changed if any of the increments would fail.
+* Reply: Array of Integers, the fields' values after the increments.
+*/
+int HMIncrByCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if ((argc < 4) || (argc % 2 != 0)) {
+    return RedisModule_WrongArity(ctx);
+  }
+  RedisModule_AutoMemory(ctx);
+
+  // open the key and make sure it is indeed a Hash and not empty
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+
+  if ((RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) &&
+      (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_HASH)) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  /* Compute all the new values before setting any of them. A repeated field
+   * is incremented from its previous occurrence's result. */
+  int i, j, numfields = (argc - 2) / 2;
+  long long *vals = RedisModule_PoolAlloc(ctx, numfields * sizeof(*vals));
+  for (i = 0; i < numfields; i++) {
+    RedisModuleString *field = argv[2 + 2 * i];
+    long long incr, cur = 0;
+    if (RedisModule_StringToLongLong(argv[3 + 2 * i], &incr) !=
+        REDISMODULE_OK) {
+      RedisModule_ReplyWithError(ctx,
+                                 "ERR value is not an integer or out of range");
+      return REDISMODULE_ERR;
+    }
+
+    for (j = i - 1; j >= 0; j--)
+      if (RMUtil_StringEquals(field, argv[2 + 2 * j])) break;
+    if (j >= 0) {
+      cur = vals[j];
+    } else {
+      RedisModuleString *val;
+      RedisModule_HashGet(key, REDISMODULE_HASH_NONE, field, &val, NULL);
+      if (val && RedisModule_StringToLongLong(val, &cur) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, "ERR hash value is not an integer");
+        return REDISMODULE_ERR;
+      }
+    }
+
+    if (incr_overflows(cur, incr)) {
+      RedisModule_ReplyWithError(ctx,
+                                 "ERR increment or decrement would overflow");
+      return REDISMODULE_ERR;
+    }
+    vals[i] = cur + incr;
+  }
+
+  RedisModule_ReplyWithArray(ctx, numfields);
+  for (i = 0; i < numfields; i++) {
+    RedisModule_HashSet(key, REDISMODULE_HASH_NONE, argv[2 + 2 * i],
+                        RedisModule_CreateStringFromLongLong(ctx, vals[i]),
+                        NULL);
+    RedisModule_ReplyWithLongLong(ctx, vals[i]);
+  }
+
+  return REDISMODULE_OK;
+}
+
+/*
+* HAGG key SUM|MIN|MAX|AVG|COUNT [PATTERN pattern]
+* Aggregates the numeric values of a Hash's fields, optionally only of those
+* with names matching 'pattern' (a POSIX Extended Regular Expression).
+* Values that aren't numbers are ignored.
+* Reply: String, the aggregate as a double (NULL for the MIN, MAX and AVG of
+* no values), or Integer for COUNT.
+*/
+int HAggCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if ((argc != 3) && (argc != 5)) {
+    return RedisModule_WrongArity(ctx);
+  }
+  RedisModule_AutoMemory(ctx);
+
+  enum { agg_sum, agg_min, agg_max, agg_avg, agg_count } agg;
+  const char *aggname = RedisModule_StringPtrLen(argv[2], NULL);
+  if (!strcasecmp("sum", aggname))
+    agg = agg_sum;
+  else if (!strcasecmp("min", aggname))
+    agg = agg_min;
+  else if (!strcasecmp("max", aggname))
+    agg = agg_max;
+  else if (!strcasecmp("avg", aggname))
+    agg = agg_avg;
+  else if (!strcasecmp("count", aggname))
+    agg = agg_count;
+  else {
+    RedisModule_ReplyWithError(
+        ctx, "ERR invalid aggregate - must be sum, min, max, avg or count");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if ((RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) &&
+      (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_HASH)) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  /* Compile a regex from the pattern, if given. */
+  regex_t regex;
+  int filter = 0;
+  if (argc == 5) {
+    if (strcasecmp("pattern", RedisModule_StringPtrLen(argv[3], NULL))) {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
+    }
+    const char *pat = RedisModule_StringPtrLen(argv[4], NULL);
+    if (RMUtil_RegexCompile(ctx, &regex, pat)) return REDISMODULE_ERR;
+    filter = 1;
+  }
+
+  /* Parse the values straight from the call reply. */
+  RedisModuleCallReply *rep = RedisModule_Call(ctx, "HGETALL", "s", argv[1]);
+  if (filter && (rep == NULL ||
+                 RedisModule_CallReplyType(rep) == REDISMODULE_REPLY_ERROR))
+    regfree(&regex);
+  RMUTIL_ASSERT_NOERROR(rep)
+
+  size_t len = RedisModule_CallReplyLength(rep);
+  size_t i, buflen = 0;
+  char *buf = NULL, *eptr;
+  long long count = 0;
+  double sum = 0, min = 0, max = 0;
+  for (i = 0; i + 1 < len; i += 2) {
+    size_t flen, vlen;
+    if (filter) {
+      const char *field = RedisModule_CallReplyStringPtr(
+          RedisModule_CallReplyArrayElement(rep, i), &flen);
+      if (!RMUtil_RegexMatchBuf(&regex, field, flen, &buf, &buflen))
+        continue;
+    }
+
+    const char *val = RedisModule_CallReplyStringPtr(
+        RedisModule_CallReplyArrayElement(rep, i + 1), &vlen);
+    if (vlen == 0 || isspace((unsigned char)val[0]) || vlen + 1 > 64)
+      continue;
+    char num[64];
+    memcpy(num, val, vlen);
+    num[vlen] = '\0';
+    double d = strtod(num, &eptr);
+    if (*eptr != '\0' || isnan(d)) continue;
+
+    if (!count || d < min) min = d;
+    if (!count || d > max) max = d;
+    sum += d;
+    count++;
+  }
+  if (filter) regfree(&regex);
+  free(buf);
+
+  switch (agg) {
+    case agg_count:
+      RedisModule_ReplyWithLongLong(ctx, count);
+      break;
+    case agg_sum:
+      RedisModule_ReplyWithDouble(ctx, sum);
+      break;
+    default:
+      if (!count)
+        RedisModule_ReplyWithNull(ctx);
+      else
+        RedisModule_ReplyWithDouble(
+            ctx, (agg == agg_min ? min : (agg == agg_max ? max : sum / count)));
+  }
+
+  return REDISMODULE_OK;
+}
+
+/* A value of an indexed field, as stored in an index document. */
+typedef struct {
+  char *str; /* NULL if the field is missing */
+  size_t len;
+  int isnum;
+  double num;
+} HIdxValue;
+
+/*
+* An entry in the ordered numeric view of an indexed field. The view is a
+* skiplist ordered by value, then by document, whose links count the entries
+* they skip so that positions are found in logarithmic time.
+*/
+#define HIDX_MAXLEVEL 32
+typedef struct HIdxNum {
+  double num;
+  HashMapEntry *doc;
+  struct {
+    struct HIdxNum *next;
+    size_t span;
+  } level[];
+} HIdxNum;
+
+/*
+* A secondary index over the fields of the Hashes whose names start with a
+* prefix. Every indexed Hash is a document in the docs map, keyed by its name
+* and holding the values it was indexed with. Per field, equality lookups go
+* through a map from value to a set of documents, and numeric values are kept
+* in a skiplist for range lookups. Sets of documents are hash maps keyed by the
+* documents' entry pointers.
+*/
+typedef struct {
+  int db;
+  char *prefix;
+  size_t prefixlen;
+  int numfields;
+  char **fields;
+  HashMap **values;
+  HIdxNum **nums; /* skiplist headers */
+  int *numslevel;
+  size_t *numslen;
+  HashMap *docs;
+} HIdx;
+
+/* All indexes by name. Indexes live in memory only, they are neither
+ * persisted nor replicated. */
+HashMap *hidx_indexes = NULL;
+
+/* Return a new skiplist node with room for level links. */
+HIdxNum *hidx_num_new(int level, double num, HashMapEntry *doc) {
+  HIdxNum *n =
+      RedisModule_Calloc(1, sizeof(HIdxNum) + level * sizeof(n->level[0]));
+  n->num = num;
+  n->doc = doc;
+  return n;
+}
+
+/* Return 1 if a skiplist node orders before the (num, doc) entry. */
+int hidx_num_before(HIdxNum *n, double num, HashMapEntry *doc) {
+  return (n->num < num ||
+          (n->num == num && (uintptr_t)n->doc < (uintptr_t)doc));
+}
+
+/* Return the position of the first numeric entry not less than num (or
+ * greater than num if after is set) in field f's ordered view. If node
+ * isn't NULL, it is set to that entry, or NULL if there is none. */
+size_t hidx_bound(HIdx *idx, int f, double num, int after, HIdxNum **node) {
+  HIdxNum *x = idx->nums[f];
+  size_t rank = 0;
+  for (int i = idx->numslevel[f] - 1; i >= 0; i--) {
+    while (x->level[i].next && (x->level[i].next->num < num ||
+                                (after && x->level[i].next->num == num))) {
+      rank += x->level[i].span;
+      x = x->level[i].next;
+    }
+  }
+  if (node) *node = x->level[0].next;
+  return rank;
+}
+
+/* Insert a document's value into field f's ordered view. */
+void hidx_num_insert(HIdx *idx, int f, double num, HashMapEntry *doc) {
+  HIdxNum *update[HIDX_MAXLEVEL], *x = idx->nums[f];
+  size_t rank[HIDX_MAXLEVEL];
+  for (int i = idx->numslevel[f] - 1; i >= 0; i--) {
+    rank[i] = (i == idx->numslevel[f] - 1 ? 0 : rank[i + 1]);
+    while (x->level[i].next && hidx_num_before(x->level[i].next, num, doc)) {
+      rank[i] += x->level[i].span;
+      x = x->level[i].next;
+    }
+    update[i] = x;
+  }
+
+  int level = 1;
+  while (level < HIDX_MAXLEVEL && (rand() & 0xFFFF) < 0xFFFF / 4) level++;
+  if (level > idx->numslevel[f]) {
+    for (int i = idx->numslevel[f]; i < level; i++) {
+      rank[i] = 0;
+      update[i] = idx->nums[f];
+      update[i]->level[i].span = idx->numslen[f];
+    }
+    idx->numslevel[f] = level;
+  }
+
+  x = hidx_num_new(level, num, doc);
+  for (int i = 0; i < level; i++) {
+    x->level[i].next = update[i]->level[i].next;
+    update[i]->level[i].next = x;
+    x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+    update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+  }
+  for (int i = level; i < idx->numslevel[f]; i++) update[i]->level[i].span++;
+  idx->numslen[f]++;
+}
+
+/* Delete a document's value from field f's ordered view. */
+void hidx_num_delete(HIdx *idx, int f, double num, HashMapEntry *doc) {
+  HIdxNum *update[HIDX_MAXLEVEL], *x = idx->nums[f];
+  for (int i = idx->numslevel[f] - 1; i >= 0; i--) {
+    while (x->level[i].next && hidx_num_before(x->level[i].next, num, doc))
+      x = x->level[i].next;
+    update[i] = x;
+  }
+  x = x->level[0].next;
+  if (!x || x->doc != doc) return;
+
+  for (int i = 0; i < idx->numslevel[f]; i++) {
+    if (update[i]->level[i].next == x) {
+      update[i]->level[i].span += x->level[i].span - 1;
+      update[i]->level[i].next = x->level[i].next;
+    } else {
+      update[i]->level[i].span--;
+    }
+  }
+  while (idx->numslevel[f] > 1 &&
+         !idx->nums[f]->level[idx->numslevel[f] - 1].next)
+    idx->numslevel[f]--;
+  idx->numslen[f]--;
+  RedisModule_Free(x);
+}
+
+/* Add a document's value of field f to the field's indexes. */
+void hidx_add_field(HIdx *idx, HashMapEntry *doc, int f) {
+  HIdxValue *v = &((HIdxValue *)doc->value)[f];
+  if (!v->str) return;
+
+  HashMapEntry *e = HashMap_Insert(idx->values[f], v->str, v->len, NULL);
+  if (!e->value) e->value = NewHashMap(4);
+  HashMap_Put(e->value, (char *)&doc, sizeof(doc), doc);
+  if (v->isnum) hidx_num_insert(idx, f, v->num, doc);
+}
+
+/* Remove a document's value of field f from the field's indexes and release
+ * it. */
+void hidx_remove_field(HIdx *idx, HashMapEntry *doc, int f) {
+  HIdxValue *v = &((HIdxValue *)doc->value)[f];
+  if (!v->str) return;
+
+  HashMap *set = HashMap_Get(idx->values[f], v->str, v->len);
+  if (set) {
+    HashMap_Delete(set, (char *)&doc, sizeof(doc), NULL);
+    if (!HashMap_Size(set)) {
+      HashMap_Delete(idx->values[f], v->str, v->len, NULL);
+      HashMap_Free(set, NULL);
+    }
+  }
+  if (v->isnum) hidx_num_delete(idx, f, v->num, doc);
+  RedisModule_Free(v->str);
+  v->str = NULL;
+}
+
+/* Add a document to the indexes of all the fields it has. */
+void hidx_add(HIdx *idx, HashMapEntry *doc) {
+  for (int f = 0; f < idx->numfields; f++) hidx_add_field(idx, doc, f);
+}
+
+/* Remove a document from all the field indexes and release its values. */
+void hidx_remove(HIdx *idx, HashMapEntry *doc) {
+  for (int f = 0; f < idx->numfields; f++) hidx_remove_field(idx, doc, f);
+  RedisModule_Free(doc->value);
+}
+
+/*
+* Bring the index up to date with the current contents of a key. Keys that
+* are outside of the prefix are ignored, and keys that aren't Hashes or have
+* none of the indexed fields are dropped from the index.
+* Returns 1 if the key is indexed, 0 otherwise.
+*/
+int hidx_update(RedisModuleCtx *ctx, HIdx *idx, RedisModuleString *keyname) {
+  size_t len;
+  const char *name = RedisModule_StringPtrLen(keyname, &len);
+  if (len < idx->prefixlen || memcmp(name, idx->prefix, idx->prefixlen))
+    return 0;
+
+  HIdxValue *vals = NULL;
+  int found = 0;
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_HASH) {
+    vals = RedisModule_Calloc(idx->numfields, sizeof(HIdxValue));
+    for (int f = 0; f < idx->numfields; f++) {
+      RedisModuleString *val;
+      RedisModule_HashGet(key, REDISMODULE_HASH_CFIELDS, idx->fields[f], &val,
+                          NULL);
+      if (!val) continue;
+
+      size_t vlen;
+      const char *v = RedisModule_StringPtrLen(val, &vlen);
+      vals[f].str = RedisModule_Alloc(vlen + 1);
+      memcpy(vals[f].str, v, vlen);
+      vals[f].str[vlen] = '\0';
+      vals[f].len = vlen;
+      char *eptr;
+      vals[f].num = strtod(vals[f].str, &eptr);
+      vals[f].isnum = vlen && *eptr == '\0' && !isnan(vals[f].num);
+      RedisModule_FreeString(ctx, val);
+      found++;
+    }
+  }
+  RedisModule_CloseKey(key);
+
+  HashMapEntry *doc = HashMap_Find(idx->docs, name, len);
+  if (!found) {
+    RedisModule_Free(vals);
+    if (doc) {
+      hidx_remove(idx, doc);
+      HashMap_Delete(idx->docs, name, len, NULL);
+    }
+    return 0;
+  }
+  if (!doc) {
+    doc = HashMap_Put(idx->docs, name, len, vals);
+    hidx_add(idx, doc);
+    return 1;
+  }
+
+  /* Only re-index the fields whose values changed. */
+  HIdxValue *old = doc->value;
+  for (int f = 0; f < idx->numfields; f++) {
+    if ((!old[f].str && !vals[f].str) ||
+        (old[f].str && vals[f].str && old[f].len == vals[f].len &&
+         !memcmp(old[f].str, vals[f].str, vals[f].len))) {
+      RedisModule_Free(vals[f].str);
+      continue;
+    }
+    hidx_remove_field(idx, doc, f);
+    old[f] = vals[f];
+    hidx_add_field(idx, doc, f);
+  }
+  RedisModule_Free(vals);
+  return 1;
+}
+
+/* Set up the empty documents map and per-field lookups of an index. */
+void hidx_init(HIdx *idx) {
+  idx->docs = NewHashMap(16);
+  for (int f = 0; f < idx->numfields; f++) {
+    idx->values[f] = NewHashMap(16);
+    idx->nums[f] = hidx_num_new(HIDX_MAXLEVEL, 0, NULL);
+    idx->numslevel[f] = 1;
+    idx->numslen[f] = 0;
+  }
+}
+
+/* Release the documents and per-field lookups of an index. */
+void hidx_clear(HIdx *idx) {
+  HashMapIterator it = HashMap_Iterate(idx->docs);
+  HashMapEntry *doc;
+  while ((doc = HashMapIterator_Next(&it))) {
+    HIdxValue *vals = doc->value;
+    for (int f = 0; f < idx->numfields; f++) RedisModule_Free(vals[f].str);
+    RedisModule_Free(vals);
+  }
+  HashMap_Free(idx->docs, NULL);
+
+  for (int f = 0; f < idx->numfields; f++) {
+    HashMapIterator vit = HashMap_Iterate(idx->values[f]);
+    HashMapEntry *e;
+    while ((e = HashMapIterator_Next(&vit))) HashMap_Free(e->value, NULL);
+    HashMap_Free(idx->values[f], NULL);
+    HIdxNum *n = idx->nums[f];
+    while (n) {
+      HIdxNum *next = n->level[0].next;
+      RedisModule_Free(n);
+      n = next;
+    }
+  }
+}
+
+/* Release an index and everything it owns. */
+void hidx_free(HIdx *idx) {
+  hidx_clear(idx);
+  for (int f = 0; f < idx->numfields; f++) RedisModule_Free(idx->fields[f]);
+  RedisModule_Free(idx->values);
+  RedisModule_Free(idx->nums);
+  RedisModule_Free(idx->numslevel);
+  RedisModule_Free(idx->numslen);
+  RedisModule_Free(idx->fields);
+  RedisModule_Free(idx->prefix);
+  RedisModule_Free(idx);
+}
+
+/* Keyspace notifications handler that keeps the indexes up to date. */
+int HIdxNotify(RedisModuleCtx *ctx, int type, const char *event,
+               RedisModuleString *key) {
+  if (!HashMap_Size(hidx_indexes)) return REDISMODULE_OK;
+
+  int db = RedisModule_GetSelectedDb(ctx);
+  HashMapIterator it = HashMap_Iterate(hidx_indexes);
+  HashMapEntry *e;
+  while ((e = HashMapIterator_Next(&it))) {
+    HIdx *idx = e->value;
+    if (idx->db == db) hidx_update(ctx, idx, key);
+  }
+
+  return REDISMODULE_OK;
+}
+
+/*
+* Index the existing keys of the selected database that match an index's
+* prefix, scanning for the escaped prefix.
+* Returns the number of Hashes indexed, or -1 if scanning failed.
+*/
+long long hidx_backfill(RedisModuleCtx *ctx, HIdx *idx) {
+  char *match = RedisModule_Alloc(idx->prefixlen * 2 + 2);
+  size_t mlen = 0;
+  for (size_t i = 0; i < idx->prefixlen; i++) {
+    if (strchr("*?[]\\", idx->prefix[i])) match[mlen++] = '\\';
+    match[mlen++] = idx->prefix[i];
+  }
+  match[mlen++] = '*';
+
+  RedisModuleString *scursor = RedisModule_CreateStringFromLongLong(ctx, 0);
+  long long lcursor, indexed = 0;
+  do {
+    RedisModuleCallReply *rep =
+        RedisModule_Call(ctx, "SCAN", "scbcc", scursor, "MATCH", match, mlen,
+                         "COUNT", "1000");
+    RedisModule_FreeString(ctx, scursor);
+    if (!rep || RedisModule_CallReplyType(rep) != REDISMODULE_REPLY_ARRAY ||
+        RedisModule_CallReplyLength(rep) != 2) {
+      if (rep) RedisModule_FreeCallReply(rep);
+      RedisModule_Free(match);
+      return -1;
+    }
+    scursor = RedisModule_CreateStringFromCallReply(
+        RedisModule_CallReplyArrayElement(rep, 0));
+    RedisModule_StringToLongLong(scursor, &lcursor);
+
+    RedisModuleCallReply *rkeys = RedisModule_CallReplyArrayElement(rep, 1);
+    size_t nkeys = RedisModule_CallReplyLength(rkeys);
+    for (size_t i = 0; i < nkeys; i++) {
+      RedisModuleString *key = RedisModule_CreateStringFromCallReply(
+          RedisModule_CallReplyArrayElement(rkeys, i));
+      indexed += hidx_update(ctx, idx, key);
+      RedisModule_FreeString(ctx, key);
+    }
+    RedisModule_FreeCallReply(rep);
+  } while (lcursor);
+  RedisModule_FreeString(ctx, scursor);
+  RedisModule_Free(match);
+
+  return indexed;
+}
+
+/*
+* Keeps the indexes current across the server events that replace keys
+* without keyspace notifications: FLUSHDB and FLUSHALL empty the indexes of
+* the flushed databases, SWAPDB moves indexes along with their databases, and
+* loading a dataset (e.g. a replica's full resync) empties all of them and
+* backfills them again once it ends.
+*/
+void HIdxServerEvent(RedisModuleCtx *ctx, RedisModuleEvent eid,
+                     uint64_t subevent, void *data) {
+  HashMapIterator it = HashMap_Iterate(hidx_indexes);
+  HashMapEntry *e;
+  while ((e = HashMapIterator_Next(&it))) {
+    HIdx *idx = e->value;
+    if (eid.id == REDISMODULE_EVENT_FLUSHDB &&
+        subevent == REDISMODULE_SUBEVENT_FLUSHDB_START) {
+      int dbnum = ((RedisModuleFlushInfo *)data)->dbnum;
+      if (dbnum != -1 && dbnum != idx->db) continue;
+      hidx_clear(idx);
+      hidx_init(idx);
+    } else if (eid.id == REDISMODULE_EVENT_SWAPDB) {
+      RedisModuleSwapDbInfo *info = data;
+      if (idx->db == info->dbnum_first)
+        idx->db = info->dbnum_second;
+      else if (idx->db == info->dbnum_second)
+        idx->db = info->dbnum_first;
+    } else if (eid.id == REDISMODULE_EVENT_LOADING &&
+               (subevent == REDISMODULE_SUBEVENT_LOADING_RDB_START ||
+                subevent == REDISMODULE_SUBEVENT_LOADING_AOF_START ||
+                subevent == REDISMODULE_SUBEVENT_LOADING_REPL_START)) {
+      hidx_clear(idx);
+      hidx_init(idx);
+    } else if (eid.id == REDISMODULE_EVENT_LOADING &&
+               subevent == REDISMODULE_SUBEVENT_LOADING_ENDED) {
+      int db = RedisModule_GetSelectedDb(ctx);
+      RedisModule_SelectDb(ctx, idx->db);
+      hidx_backfill(ctx, idx);
+      RedisModule_SelectDb(ctx, db);
+    }
+  }
+}
+
+/*
+* HIDX.CREATE name PREFIX prefix FIELDS field [field ...]
+* Creates a secondary index over fields of the Hashes in the current database
+* whose names start with prefix. Existing Hashes are indexed right away, and
+* the index is then kept up to date on every change to a matching key.
+* Indexes are kept in memory only and are lost on restart.
+* Reply: Integer, the number of Hashes indexed.
+*/
+int HIdxCreateCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
+  if (argc < 6) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  if (strcasecmp("prefix", RedisModule_StringPtrLen(argv[2], NULL)) ||
+      strcasecmp("fields", RedisModule_StringPtrLen(argv[4], NULL))) {
+    RedisModule_ReplyWithError(ctx, "ERR syntax error");
+    return REDISMODULE_ERR;
+  }
+
+  size_t nlen;
+  const char *name = RedisModule_StringPtrLen(argv[1], &nlen);
+  if (HashMap_Find(hidx_indexes, name, nlen)) {
+    RedisModule_ReplyWithError(ctx, "ERR index already exists");
+    return REDISMODULE_ERR;
+  }
+
+  size_t plen;
+  const char *prefix = RedisModule_StringPtrLen(argv[3], &plen);
+  HIdx *idx = RedisModule_Calloc(1, sizeof(HIdx));
+  idx->db = RedisModule_GetSelectedDb(ctx);
+  idx->prefix = RedisModule_Alloc(plen + 1);
+  memcpy(idx->prefix, prefix, plen);
+  idx->prefix[plen] = '\0';
+  idx->prefixlen = plen;
+  idx->numfields = argc - 5;
+  idx->fields = RedisModule_Calloc(idx->numfields, sizeof(char *));
+  idx->values = RedisModule_Calloc(idx->numfields, sizeof(HashMap *));
+  idx->nums = RedisModule_Calloc(idx->numfields, sizeof(HIdxNum *));
+  idx->numslevel = RedisModule_Calloc(idx->numfields, sizeof(int));
+  idx->numslen = RedisModule_Calloc(idx->numfields, sizeof(size_t));
+  for (int f = 0; f < idx->numfields; f++)
+    idx->fields[f] =
+        RedisModule_Strdup(RedisModule_StringPtrLen(argv[5 + f], NULL));
+  hidx_init(idx);
+
+  long long indexed = hidx_backfill(ctx, idx);
+  if (indexed < 0) {
+    hidx_free(idx);
+    RedisModule_ReplyWithError(ctx, "ERR failed scanning the keyspace");
+    return REDISMODULE_ERR;
+  }
+
+  HashMap_Put(hidx_indexes, name, nlen, idx);
+  RedisModule_ReplyWithLongLong(ctx, indexed);
+  return REDISMODULE_OK;
+}
+
+/*
+* HIDX.DROP name
+* Deletes a secondary index. The indexed Hashes are left untouched.
+* Reply: Integer, 1 if the index existed, 0 otherwise.
+*/
+int HIdxDropCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  size_t nlen;
+  const char *name = RedisModule_StringPtrLen(argv[1], &nlen);
+  void *idx;
+  if (!HashMap_Delete(hidx_indexes, name, nlen, &idx)) {
+    RedisModule_ReplyWithLongLong(ctx, 0);
+    return REDISMODULE_OK;
+  }
+  hidx_free(idx);
+
+  RedisModule_ReplyWithLongLong(ctx, 1);
+  return REDISMODULE_OK;
+}
+
+/* A parsed HIDX.QUERY condition. */
+typedef struct {
+  int field;
+  int isrange;
+  const char *val;
+  size_t len;
+  double min, max;
+  int minex, maxex;
+  size_t first, last; /* ordered view slice for ranges */
+  HIdxNum *start;
+} HIdxCond;
+
+/* Parse a range bound, optionally prefixed by '(' for an exclusive one. */
+int hidx_parse_bound(RedisModuleString *arg, double *d, int *ex) {
+  const char *s = RedisModule_StringPtrLen(arg, NULL);
+  char *eptr;
+  *ex = (*s == '(');
+  if (*ex) s++;
+  *d = strtod(s, &eptr);
+  return (*s == '\0' || *eptr != '\0' || isnan(*d));
+}
+
+/* Check whether a document satisfies a condition. */
+int hidx_match(HIdxValue *vals, HIdxCond *c) {
+  HIdxValue *v = &vals[c->field];
+  if (!v->str) return 0;
+  if (!c->isrange) return (v->len == c->len && !memcmp(v->str, c->val, c->len));
+  if (!v->isnum) return 0;
+  if (v->num < c->min || (c->minex && v->num == c->min)) return 0;
+  if (v->num > c->max || (c->maxex && v->num == c->max)) return 0;
+  return 1;
+}
+
+/*
+* HIDX.QUERY name (EQ field value | RANGE field min max) [...]
+* Returns the names of the Hashes that satisfy all of the conditions, using
+* the index instead of scanning. EQ compares a field's value exactly, RANGE
+* selects numeric values between min and max, inclusive unless prefixed by
+* '(', where -inf and +inf are also valid. The index can only be queried from
+* the database it was created in.
+* Reply: Array of Strings, the matching key names.
+*/
+int HIdxQueryCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 5) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  size_t nlen;
+  const char *name = RedisModule_StringPtrLen(argv[1], &nlen);
+  HIdx *idx = HashMap_Get(hidx_indexes, name, nlen);
+  if (!idx) {
+    RedisModule_ReplyWithError(ctx, "ERR no such index");
+    return REDISMODULE_ERR;
+  }
+  /* The documents are checked, and stale ones dropped, in this database. */
+  if (idx->db != RedisModule_GetSelectedDb(ctx)) {
+    RedisModule_ReplyWithError(ctx, "ERR index belongs to another database");
+    return REDISMODULE_ERR;
+  }
+
+  /* Parse the conditions. */
+  HIdxCond *conds = RedisModule_PoolAlloc(ctx, argc * sizeof(HIdxCond));
+  int nconds = 0;
+  int i = 2;
+  while (i < argc) {
+    HIdxCond *c = &conds[nconds];
+    const char *op = RedisModule_StringPtrLen(argv[i], NULL);
+    memset(c, 0, sizeof(*c));
+    if (!strcasecmp("eq", op) && i + 2 < argc) {
+      c->val = RedisModule_StringPtrLen(argv[i + 2], &c->len);
+      i += 3;
+    } else if (!strcasecmp("range", op) && i + 3 < argc) {
+      c->isrange = 1;
+      if (hidx_parse_bound(argv[i + 2], &c->min, &c->minex) ||
+          hidx_parse_bound(argv[i + 3], &c->max, &c->maxex)) {
+        RedisModule_ReplyWithError(ctx, "ERR min or max is not a float");
+        return REDISMODULE_ERR;
+      }
+      i += 4;
+    } else {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
+    }
+
+    const char *field = RedisModule_StringPtrLen(argv[i - (c->isrange ? 3 : 2)],
+                                                 NULL);
+    for (c->field = 0; c->field < idx->numfields; c->field++)
+      if (!strcmp(idx->fields[c->field], field)) break;
+    if (c->field == idx->numfields) {
+      RedisModule_ReplyWithError(ctx, "ERR field is not indexed");
+      return REDISMODULE_ERR;
+    }
+    nconds++;
+  }
+
+  /* Drive the lookup with the most selective condition. */
+  int driver = 0;
+  size_t best = SIZE_MAX;
+  HashMap *set = NULL;
+  for (i = 0; i < nconds; i++) {
+    HIdxCond *c = &conds[i];
+    size_t n;
+    if (c->isrange) {
+      c->first = hidx_bound(idx, c->field, c->min, c->minex, &c->start);
+      c->last = hidx_bound(idx, c->field, c->max, !c->maxex, NULL);
+      n = (c->last > c->first ? c->last - c->first : 0);
+    } else {
+      HashMap *s = HashMap_Get(idx->values[c->field], c->val, c->len);
+      n = (s ? HashMap_Size(s) : 0);
+    }
+    if (n < best) {
+      best = n;
+      driver = i;
+    }
+  }
+
+  Vector *matches = NewVector(HashMapEntry *, best ? best : 1);
+  if (best) {
+    HIdxCond *d = &conds[driver];
+    HashMapIterator it;
+    HashMapEntry *e = NULL;
+    size_t pos = d->first;
+    HIdxNum *n = d->start;
+    if (!d->isrange) {
+      set = HashMap_Get(idx->values[d->field], d->val, d->len);
+      it = HashMap_Iterate(set);
+    }
+    while (1) {
+      HashMapEntry *doc;
+      if (d->isrange) {
+        if (pos >= d->last) break;
+        doc = n->doc;
+        n = n->level[0].next;
+        pos++;
+      } else {
+        if (!(e = HashMapIterator_Next(&it))) break;
+        doc = e->value;
+      }
+
+      for (i = 0; i < nconds; i++)
+        if (i != driver && !hidx_match(doc->value, &conds[i])) break;
+      if (i == nconds) Vector_Push(matches, doc);
+    }
+  }
+
+  /* Reply with the matches, skipping keys that are somehow no longer
+   * Hashes, which are then dropped. */
+  size_t n = Vector_Size(matches);
+  size_t len = 0, nstale = 0;
+  RedisModuleString **stale =
+      RedisModule_PoolAlloc(ctx, (n ? n : 1) * sizeof(RedisModuleString *));
+  RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+  for (size_t j = 0; j < n; j++) {
+    HashMapEntry *doc;
+    Vector_Get(matches, j, &doc);
+    RedisModuleString *keyname =
+        RedisModule_CreateString(ctx, doc->key, doc->keylen);
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_HASH) {
+      RedisModule_ReplyWithString(ctx, keyname);
+      len++;
+    } else {
+      stale[nstale++] = keyname;
+    }
+    RedisModule_CloseKey(key);
+  }
+  RedisModule_ReplySetArrayLength(ctx, len);
+  Vector_Free(matches);
+
+  for (size_t j = 0; j < nstale; j++) hidx_update(ctx, idx, stale[j]);
+
+  return REDISMODULE_OK;
+}
+
 int testHGetSet(RedisModuleCtx *ctx) {
   RedisModuleCallReply *r;
 
@@ -70,6 +1313,218 @@ int testHGetSet(RedisModuleCtx *ctx) {
   return 0;
 }
 
+int testHMGetSet(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "hmgetset", "ccccc", "foo", "a", "1", "b", "2");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_Assert(RedisModule_CallReplyType(RedisModule_CallReplyArrayElement(
+                    r, 0)) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "hmgetset", "ccccccc", "foo", "a", "3", "b", "4",
+                       "a", "5");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "2");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "3");
+  r = RedisModule_Call(ctx, "HGET", "cc", "foo", "a");
+  RMUtil_AssertReplyEquals(r, "5");
+  r = RedisModule_Call(ctx, "mhgetset", "cccc", "a", "6", "foo", "bar");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "5");
+  RMUtil_Assert(RedisModule_CallReplyType(RedisModule_CallReplyArrayElement(
+                    r, 1)) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "HGET", "cc", "bar", "a");
+  RMUtil_AssertReplyEquals(r, "6");
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testHCheckAnd(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "hcheckand", "cccccc", "foo", "ver", "1", "THEN",
+                       "HSET", "a");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "hcheckand", "ccccccc", "foo", "ver", "1", "THEN",
+                       "HSET", "a", "1");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "ver", "1");
+  r = RedisModule_Call(ctx, "hcheckand", "ccccccccc", "foo", "ver", "1",
+                       "THEN", "HSET", "a", "1", "ver", "2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "hcheckand", "ccccccc", "foo", "ver", "1", "THEN",
+                       "HINCRBY", "a", "5");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "hcheckand", "ccccccccc", "foo", "ver", "2", "a",
+                       "1", "THEN", "HINCRBY", "a", "5");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 6);
+  r = RedisModule_Call(ctx, "hcheckand", "cccccccc", "foo", "ver", "2", "THEN",
+                       "HDEL", "a", "b", "c");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "HLEN", "c", "foo");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testHMGetMulti(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "HSET", "ccc", "u1", "name", "foo");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "u2", "score", "42");
+  r = RedisModule_Call(ctx, "hmgetmulti", "cccccc", "2", "name", "score", "u1",
+                       "u2", "u3");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "1 1"),
+                           "foo");
+  RMUtil_Assert(RedisModule_CallReplyType(
+                    RedisModule_CallReplyArrayElementByPath(r, "1 2")) ==
+                REDISMODULE_REPLY_NULL);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "2 2"),
+                           "42");
+  RMUtil_Assert(RedisModule_CallReplyLength(
+                    RedisModule_CallReplyArrayElement(r, 2)) == 2);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testHPScan(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "hpscan", "ccc", "foo", "0", "^a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "0");
+  RMUtil_Assert(RedisModule_CallReplyLength(
+                    RedisModule_CallReplyArrayElement(r, 1)) == 0);
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "ab", "1");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "ac", "2");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "bc", "3");
+  r = RedisModule_Call(ctx, "hpscan", "cccccc", "foo", "0", "c$", "VALUES",
+                       "BUDGET", "1000000");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "0");
+  RMUtil_Assert(RedisModule_CallReplyLength(
+                    RedisModule_CallReplyArrayElement(r, 1)) == 4);
+  r = RedisModule_Call(ctx, "hpscan", "ccc", "foo", "0", "^a");
+  RMUtil_Assert(RedisModule_CallReplyLength(
+                    RedisModule_CallReplyArrayElement(r, 1)) == 2);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testHMIncrBy(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "hmincrby", "ccccccc", "foo", "a", "1", "b", "2",
+                       "a", "3");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 0)) == 1);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 2)) == 4);
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "c", "bar");
+  r = RedisModule_Call(ctx, "hmincrby", "ccccc", "foo", "a", "1", "c", "1");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "HGET", "cc", "foo", "a");
+  RMUtil_AssertReplyEquals(r, "4");
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testHAgg(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "hagg", "cc", "foo", "max");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "a1", "1");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "a2", "2.5");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "b1", "10");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "foo", "b2", "bar");
+  r = RedisModule_Call(ctx, "hagg", "cc", "foo", "count");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "hagg", "cc", "foo", "sum");
+  RMUtil_AssertReplyEquals(r, "13.5");
+  r = RedisModule_Call(ctx, "hagg", "cc", "foo", "min");
+  RMUtil_AssertReplyEquals(r, "1");
+  r = RedisModule_Call(ctx, "hagg", "cccc", "foo", "max", "PATTERN", "^a");
+  RMUtil_AssertReplyEquals(r, "2.5");
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testHIdx(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "HSET", "ccc", "order:1", "status", "pending");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "order:1", "total", "10");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "order:2", "status", "shipped");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "order:2", "total", "25.5");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "user:1", "status", "pending");
+  r = RedisModule_Call(ctx, "hidx.create", "cccccc", "orders", "PREFIX",
+                       "order:", "FIELDS", "status", "total");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "hidx.query", "cccc", "orders", "EQ", "status",
+                       "pending");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0),
+                           "order:1");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "order:3", "total", "30");
+  r = RedisModule_Call(ctx, "hidx.query", "ccccc", "orders", "RANGE", "total",
+                       "(10", "+inf");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  r = RedisModule_Call(ctx, "HSET", "ccc", "order:2", "status", "pending");
+  r = RedisModule_Call(ctx, "hidx.query", "cccccccc", "orders", "EQ",
+                       "status", "pending", "RANGE", "total", "20", "30");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0),
+                           "order:2");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "order:3", "total", "5");
+  r = RedisModule_Call(ctx, "hidx.query", "ccccc", "orders", "RANGE", "total",
+                       "-inf", "10");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  r = RedisModule_Call(ctx, "DEL", "c", "order:2");
+  r = RedisModule_Call(ctx, "hidx.query", "cccc", "orders", "EQ", "status",
+                       "pending");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RedisModule_SelectDb(ctx, 1);
+  r = RedisModule_Call(ctx, "hidx.query", "cccc", "orders", "EQ", "status",
+                       "pending");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  RedisModule_SelectDb(ctx, 0);
+  r = RedisModule_Call(ctx, "hidx.query", "cccc", "orders", "EQ", "status",
+                       "pending");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  r = RedisModule_Call(ctx, "SWAPDB", "cc", "0", "1");
+  r = RedisModule_Call(ctx, "hidx.query", "cccc", "orders", "EQ", "status",
+                       "pending");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  RedisModule_SelectDb(ctx, 1);
+  r = RedisModule_Call(ctx, "hidx.query", "cccc", "orders", "EQ", "status",
+                       "pending");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RedisModule_SelectDb(ctx, 0);
+  r = RedisModule_Call(ctx, "SWAPDB", "cc", "0", "1");
+  r = RedisModule_Call(ctx, "FLUSHDB", "");
+  r = RedisModule_Call(ctx, "HSET", "ccc", "order:4", "status", "pending");
+  r = RedisModule_Call(ctx, "hidx.query", "cccc", "orders", "EQ", "status",
+                       "pending");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0),
+                           "order:4");
+  r = RedisModule_Call(ctx, "hidx.drop", "c", "orders");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "hidx.query", "cccc", "orders", "EQ", "status",
+                       "pending");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
 int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   RedisModule_AutoMemory(ctx);
 
@@ -82,6 +1537,13 @@ int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   }
 
   RMUtil_Test(testHGetSet);
+  RMUtil_Test(testHMGetSet);
+  RMUtil_Test(testHCheckAnd);
+  RMUtil_Test(testHMGetMulti);
+  RMUtil_Test(testHPScan);
+  RMUtil_Test(testHMIncrBy);
+  RMUtil_Test(testHAgg);
+  if (hidx_indexes) RMUtil_Test(testHIdx);
 
   RedisModule_ReplyWithSimpleString(ctx, "PASS");
   return REDISMODULE_OK;
@@ -96,6 +1558,62 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                 "write fast deny-oom", 1, 1,
                                 1) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "hmgetset", HMGetSetCommand,
+                                "write fast deny-oom", 1, 1,
+                                1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "mhgetset", MHGetSetCommand,
+                                "write deny-oom", 3, -1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "hcheckand", HCheckAndCommand,
+                                "write fast deny-oom", 1, 1,
+                                1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "hmgetmulti", HMGetMultiCommand,
+                                "readonly getkeys-api", 0, 0,
+                                0) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "hpscan", HPScanCommand, "readonly", 1,
+                                1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "hmincrby", HMIncrByCommand,
+                                "write fast deny-oom", 1, 1,
+                                1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "hagg", HAggCommand, "readonly", 1, 1,
+                                1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  /* The secondary indexes are kept up to date by keyspace notifications and
+   * server events, which older servers don't provide. */
+  if (RedisModule_SubscribeToKeyspaceEvents &&
+      RedisModule_SubscribeToServerEvent) {
+    hidx_indexes = NewHashMap(8);
+    if (RedisModule_SubscribeToKeyspaceEvents(
+            ctx, REDISMODULE_NOTIFY_GENERIC | REDISMODULE_NOTIFY_HASH |
+                     REDISMODULE_NOTIFY_EXPIRED | REDISMODULE_NOTIFY_EVICTED,
+            HIdxNotify) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_FlushDB,
+                                           HIdxServerEvent) ==
+            REDISMODULE_ERR ||
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_SwapDB,
+                                           HIdxServerEvent) ==
+            REDISMODULE_ERR ||
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_Loading,
+                                           HIdxServerEvent) ==
+            REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "hidx.create", HIdxCreateCommand,
+                                  "readonly", 0, 0, 0) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "hidx.query", HIdxQueryCommand,
+                                  "readonly", 0, 0, 0) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "hidx.drop", HIdxDropCommand,
+                                  "readonly fast", 0, 0,
+                                  0) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+  }
   if (RedisModule_CreateCommand(ctx, "rxhashes.test", TestModule, "write", 0,
                                 0, 0) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
@@ -20,26 +20,11 @@
 #include "../redismodule.h"
 #include "../rmutil/util.h"
 #include "../rmutil/vector.h"
+#include "../rmutil/regex_util.h"
 #include "../rmutil/test_util.h"
 
 #define RM_MODULE_NAME "rxkeys"
 
-/* Helper function: compiles a regex, or dies complaining. */
-int regex_comp(RedisModuleCtx *ctx, regex_t *r, const char *t) {
-  int status = regcomp(r, t, REG_EXTENDED | REG_NOSUB | REG_NEWLINE);
-
-  if (status) {
-    char rerr[128];
-    char err[256];
-    regerror(status, r, rerr, 128);
-    sprintf(err, "ERR regex compilation failed: %s", rerr);
-    RedisModule_ReplyWithError(ctx, err);
-    return status;
-  }
-
-  return 0;
-}
-
 /* Helper function: matches CallReplyStrings in a CallReplyArray and returns
  * RedisStrings. */
 Vector *regex_match(RedisModuleCtx *ctx, RedisModuleCallReply *rmcr,
@@ -81,7 +66,7 @@ int PKeysCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
 
   /* Compile a regex from the pattern. */
   regex_t regex;
-  if (regex_comp(ctx, &regex, pat)) return REDISMODULE_ERR;
+  if (RMUtil_RegexCompile(ctx, &regex, pat)) return REDISMODULE_ERR;
 
   /* Scan the keyspace. */
   RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
@@ -135,7 +120,7 @@ int PDelCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
 
   /* Compile a regex from the pattern. */
   regex_t regex;
-  if (regex_comp(ctx, &regex, pat)) return REDISMODULE_ERR;
+  if (RMUtil_RegexCompile(ctx, &regex, pat)) return REDISMODULE_ERR;
 
   /* Scan the keyspace. */
   RedisModuleString *scursor = RedisModule_CreateStringFromLongLong(ctx, 0);
@@ -15,6 +15,7 @@
 * You should have received a copy of the GNU Affero General Public License
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -22,9 +23,86 @@
 #include "../rmutil/util.h"
 #include "../rmutil/strings.h"
 #include "../rmutil/test_util.h"
+#include "../rmutil/vector.h"
+#include "../rmutil/hashmap.h"
+#include "../rmutil/priority_queue.h"
 
 #define RM_MODULE_NAME "rxlists"
 
+/*
+* Moves up to 'count' elements from the 'srcend' of 'srckey' to the 'dstend'
+* of 'dstkey'. The elements are pushed in the order they are popped, or in
+* reverse when 'reverse' is set, in which case they are staged in a buffer and
+* pushed in a single pass. Every element is released as soon as it is pushed,
+* so callers should not enable automatic memory management, which would track
+* all of them in the context's pool.
+* Returns the number of elements moved.
+*/
+long long lsplice_move(RedisModuleCtx *ctx, RedisModuleKey *srckey,
+                       int srcend, RedisModuleKey *dstkey, int dstend,
+                       long long count, int reverse) {
+  long long moved = 0;
+
+  if (!reverse) {
+    while (moved < count) {
+      RedisModuleString *ele = RedisModule_ListPop(srckey, srcend);
+      if (ele == NULL) break;
+      RedisModule_ListPush(dstkey, dstend, ele);
+      RedisModule_FreeString(ctx, ele);
+      moved++;
+    }
+    return moved;
+  }
+
+  size_t len = RedisModule_ValueLength(srckey);
+  if ((size_t)count > len) count = len;
+  if (!count) return 0;
+
+  RedisModuleString **stage = malloc(count * sizeof(RedisModuleString *));
+  while (moved < count) {
+    stage[moved] = RedisModule_ListPop(srckey, srcend);
+    if (stage[moved] == NULL) break;
+    moved++;
+  }
+  for (long long i = moved - 1; i >= 0; i--) {
+    RedisModule_ListPush(dstkey, dstend, stage[i]);
+    RedisModule_FreeString(ctx, stage[i]);
+  }
+  free(stage);
+
+  return moved;
+}
+
+/* Opens the source and destination lists of a splice, sharing the key when
+ * both are the same list. Replies with an error and returns REDISMODULE_ERR
+ * if either key holds another type. */
+int lsplice_open(RedisModuleCtx *ctx, RedisModuleString *src,
+                 RedisModuleString *dst, RedisModuleKey **srckey,
+                 RedisModuleKey **dstkey) {
+  *srckey = RedisModule_OpenKey(ctx, src, REDISMODULE_READ | REDISMODULE_WRITE);
+  *dstkey = (RMUtil_StringEquals(src, dst)
+                 ? *srckey
+                 : RedisModule_OpenKey(ctx, dst,
+                                       REDISMODULE_READ | REDISMODULE_WRITE));
+
+  /* Src and dst key must be empty or lists. */
+  if ((RedisModule_KeyType(*srckey) != REDISMODULE_KEYTYPE_LIST &&
+       RedisModule_KeyType(*srckey) != REDISMODULE_KEYTYPE_EMPTY) ||
+      (RedisModule_KeyType(*dstkey) != REDISMODULE_KEYTYPE_LIST &&
+       RedisModule_KeyType(*dstkey) != REDISMODULE_KEYTYPE_EMPTY)) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  return REDISMODULE_OK;
+}
+
+/* Closes the keys opened by lsplice_open. */
+void lsplice_close(RedisModuleKey *srckey, RedisModuleKey *dstkey) {
+  if (dstkey != srckey) RedisModule_CloseKey(dstkey);
+  RedisModule_CloseKey(srckey);
+}
+
 /* LSPLICE srclist dstlist count
  * Moves 'count' elements from the tail of 'srclist' to the head of
  * 'dstlist'. If less than count elements are available, it moves as much
@@ -35,36 +113,27 @@
 int LSpliceCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   if (argc != 4) return RedisModule_WrongArity(ctx);
 
-  RedisModule_AutoMemory(ctx);
-
-  RedisModuleKey *srckey =
-      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-  RedisModuleKey *dstkey =
-      RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ | REDISMODULE_WRITE);
-
-  /* Src and dst key must be empty or lists. */
-  if ((RedisModule_KeyType(srckey) != REDISMODULE_KEYTYPE_LIST &&
-       RedisModule_KeyType(srckey) != REDISMODULE_KEYTYPE_EMPTY) ||
-      (RedisModule_KeyType(dstkey) != REDISMODULE_KEYTYPE_LIST &&
-       RedisModule_KeyType(dstkey) != REDISMODULE_KEYTYPE_EMPTY)) {
-    return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+  /* No automatic memory: moved elements are released as they go. */
+  RedisModuleKey *srckey, *dstkey;
+  if (lsplice_open(ctx, argv[1], argv[2], &srckey, &dstkey) ==
+      REDISMODULE_ERR) {
+    lsplice_close(srckey, dstkey);
+    return REDISMODULE_ERR;
   }
 
   long long count;
   if ((RedisModule_StringToLongLong(argv[3], &count) != REDISMODULE_OK) ||
       (count < 0)) {
+    lsplice_close(srckey, dstkey);
     return RedisModule_ReplyWithError(ctx, "ERR invalid count");
   }
 
-  while (count-- > 0) {
-    RedisModuleString *ele;
-
-    ele = RedisModule_ListPop(srckey, REDISMODULE_LIST_TAIL);
-    if (ele == NULL) break;
-    RedisModule_ListPush(dstkey, REDISMODULE_LIST_HEAD, ele);
-  }
+  /* Popping from the tail and pushing to the head keeps the order. */
+  lsplice_move(ctx, srckey, REDISMODULE_LIST_TAIL, dstkey,
+               REDISMODULE_LIST_HEAD, count, 0);
 
   size_t len = RedisModule_ValueLength(srckey);
+  lsplice_close(srckey, dstkey);
   RedisModule_ReplyWithLongLong(ctx, len);
   return REDISMODULE_OK;
 }
@@ -93,52 +162,36 @@ int LSpliceCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
 *   +   | -1  | ASC
 *   -   | -1  | DESC
 *
+* The extra work is a single pass over a buffer of the moved elements.
 * Reply: Integer, the remaining number of elements in 'srclist'.
 * Adapted from: redis/src/modules/helloworld.c
 */
 int LXSpliceCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   if ((argc < 4) || (argc % 2 != 0)) return RedisModule_WrongArity(ctx);
 
-  RedisModule_AutoMemory(ctx);
-
-  RedisModuleKey *srckey =
-      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-  RedisModuleKey *dstkey =
-      RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ | REDISMODULE_WRITE);
-
-  /* Src and dst key must be empty or lists. */
-  if ((RedisModule_KeyType(srckey) != REDISMODULE_KEYTYPE_LIST &&
-       RedisModule_KeyType(srckey) != REDISMODULE_KEYTYPE_EMPTY) ||
-      (RedisModule_KeyType(dstkey) != REDISMODULE_KEYTYPE_LIST &&
-       RedisModule_KeyType(dstkey) != REDISMODULE_KEYTYPE_EMPTY)) {
-    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-    return REDISMODULE_ERR;
-  }
-
   long long count;
   if (RedisModule_StringToLongLong(argv[3], &count) != REDISMODULE_OK) {
     RedisModule_ReplyWithError(ctx, "ERR invalid count");
     return REDISMODULE_ERR;
   }
 
-  long long srcend =
-      (count < 0 ? REDISMODULE_LIST_TAIL : REDISMODULE_LIST_HEAD);
-  long long dstend = REDISMODULE_LIST_HEAD;
+  int srcend = (count < 0 ? REDISMODULE_LIST_TAIL : REDISMODULE_LIST_HEAD);
+  int dstend = REDISMODULE_LIST_HEAD;
   int order = 1;
-  int subc = argc - 4;
-  while (subc > 0) {
-    const char *subcmd = RedisModule_StringPtrLen(argv[subc - 2], NULL);
+  for (int i = 4; i < argc; i += 2) {
+    const char *subcmd = RedisModule_StringPtrLen(argv[i], NULL);
     if (!strcasecmp("attach", subcmd)) {
-      if ((RedisModule_StringToLongLong(argv[subc - 1], &dstend) !=
+      long long end;
+      if ((RedisModule_StringToLongLong(argv[i + 1], &end) !=
            REDISMODULE_OK) ||
-          (dstend != 0) || (dstend != -1)) {
+          ((end != 0) && (end != -1))) {
         RedisModule_ReplyWithError(
             ctx, "ERR invalid destination list end - must be 0 or -1");
         return REDISMODULE_ERR;
-      } else
-        dstend = (dstend ? REDISMODULE_LIST_HEAD : REDISMODULE_LIST_TAIL);
+      }
+      dstend = (end ? REDISMODULE_LIST_TAIL : REDISMODULE_LIST_HEAD);
     } else if (!strcasecmp("order", subcmd)) {
-      const char *subval = RedisModule_StringPtrLen(argv[subc - 1], NULL);
+      const char *subval = RedisModule_StringPtrLen(argv[i + 1], NULL);
       if (!strcasecmp("asc", subval))
         order = 1;
       else if (!strcasecmp("desc", subval))
@@ -150,42 +203,29 @@ int LXSpliceCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
             ctx, "ERR invalid order - must be asc, desc or noeffort");
         return REDISMODULE_ERR;
       }
+    } else {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
     }
-    subc -= 2;
-  }
-
-  /* figure out if rotation is needed. */
-  int rot = (order && (((order == 1) && (srcend == REDISMODULE_LIST_TAIL) &&
-                        (dstend == REDISMODULE_LIST_TAIL)) ||
-                       ((order == -1) && (srcend == REDISMODULE_LIST_HEAD) &&
-                        (dstend == REDISMODULE_LIST_HEAD))));
-  if (rot) {
-    if (dstend == REDISMODULE_LIST_HEAD)
-      dstend = REDISMODULE_LIST_TAIL;
-    else
-      dstend = REDISMODULE_LIST_HEAD;
   }
 
-  long long work = 0;
-  count = llabs(count);
-  while (count-- > 0) {
-    RedisModuleString *ele;
+  /* Pushing in pop order keeps the source order only when moving between
+   * opposite ends, otherwise the elements need to be pushed in reverse. */
+  int reverse = (order == 1 ? srcend == dstend
+                            : (order == -1 ? srcend != dstend : 0));
 
-    ele = RedisModule_ListPop(srckey, srcend);
-    if (ele == NULL) break;
-    RedisModule_ListPush(dstkey, dstend, ele);
-    work++;
+  /* No automatic memory: moved elements are released as they go. */
+  RedisModuleKey *srckey, *dstkey;
+  if (lsplice_open(ctx, argv[1], argv[2], &srckey, &dstkey) ==
+      REDISMODULE_ERR) {
+    lsplice_close(srckey, dstkey);
+    return REDISMODULE_ERR;
   }
 
-  if (rot && work)
-    while (work-- > 0) {
-      RedisModuleString *ele;
-
-      ele = RedisModule_ListPop(dstkey, dstend);
-      RedisModule_ListPush(dstkey, srcend, ele);
-    }
+  lsplice_move(ctx, srckey, srcend, dstkey, dstend, llabs(count), reverse);
 
   size_t len = RedisModule_ValueLength(srckey);
+  lsplice_close(srckey, dstkey);
   RedisModule_ReplyWithLongLong(ctx, len);
   return REDISMODULE_OK;
 }
@@ -232,6 +272,40 @@ int LPopRPushCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   return REDISMODULE_OK;
 }
 
+/*
+* Pops up to 'count' elements from the 'end' of a list key, replying with an
+* array of them in head-to-tail order. Elements popped from the head are
+* streamed to the reply as they go, tail ones are staged to reverse them.
+* Every element is released right away, so callers should not enable
+* automatic memory management.
+* Returns the number of elements popped.
+*/
+long long mpop_reply(RedisModuleCtx *ctx, RedisModuleKey *key, int end,
+                     long long count) {
+  size_t len = RedisModule_ValueLength(key);
+  if ((size_t)count > len) count = len;
+
+  RedisModule_ReplyWithArray(ctx, count);
+  if (end == REDISMODULE_LIST_HEAD) {
+    for (long long i = 0; i < count; i++) {
+      RedisModuleString *ele = RedisModule_ListPop(key, end);
+      RedisModule_ReplyWithString(ctx, ele);
+      RedisModule_FreeString(ctx, ele);
+    }
+  } else if (count) {
+    RedisModuleString **stage = malloc(count * sizeof(RedisModuleString *));
+    for (long long i = 0; i < count; i++)
+      stage[i] = RedisModule_ListPop(key, end);
+    for (long long i = count - 1; i >= 0; i--) {
+      RedisModule_ReplyWithString(ctx, stage[i]);
+      RedisModule_FreeString(ctx, stage[i]);
+    }
+    free(stage);
+  }
+
+  return count;
+}
+
 /*
 * LMPOP|RMPOP list count
 * Pops 'count' elements from the head or tail of 'list'. If less
@@ -243,51 +317,195 @@ int MPopGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
                        int argc) {
   if (argc != 3) return RedisModule_WrongArity(ctx);
 
-  RedisModule_AutoMemory(ctx);
-
   /* Heads or tails? */
   int lend = REDISMODULE_LIST_HEAD;
   const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
   if (!strcasecmp(cmd, "rmpop")) lend = REDISMODULE_LIST_TAIL;
 
-  /* Obtain key. */
+  /* Obtain count. */
+  long long count;
+  if ((RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK) ||
+      (count < 0)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid count");
+    return REDISMODULE_ERR;
+  }
+
+  /* Obtain key. No automatic memory: popped elements are released as they
+   * are replied. */
   RedisModuleKey *key =
       RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
 
   /* Key must be empty or a list. */
   if ((RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_LIST &&
        RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY)) {
+    RedisModule_CloseKey(key);
     RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
     return REDISMODULE_ERR;
   }
 
-  /* Obtain count. */
+  mpop_reply(ctx, key, lend, count);
+  RedisModule_CloseKey(key);
+
+  return REDISMODULE_OK;
+}
+
+/*
+* LMPOPMULTI count list [list ...]
+* Pops up to 'count' elements in total from the heads of the lists, draining
+* them in the order they are given: a list is popped from only once all the
+* lists before it are empty.
+* Reply: Array of pairs, each a list's name and an array of the elements
+* popped from it, for the lists that had elements.
+*/
+int LMPopMultiCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
+  if (argc < 3) return RedisModule_WrongArity(ctx);
+
   long long count;
-  if ((RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK) ||
+  if ((RedisModule_StringToLongLong(argv[1], &count) != REDISMODULE_OK) ||
       (count < 0)) {
     RedisModule_ReplyWithError(ctx, "ERR invalid count");
     return REDISMODULE_ERR;
   }
 
-  /* TODO: once low level API LTRIM & LRANGE are available */
-  RedisModuleCallReply *rlrange =
-      RedisModule_Call(ctx, "LRANGE", "sll", argv[1],
-                       (lend == REDISMODULE_LIST_HEAD ? 0 : -count),
-                       (lend == REDISMODULE_LIST_HEAD ? count - 1 : -1));
-  RMUTIL_ASSERT_NOERROR(rlrange)
-  RedisModuleCallReply *rltrim = RedisModule_Call(
-      ctx, "LTRIM", "sll", argv[1], (lend == REDISMODULE_LIST_HEAD ? count : 0),
-      (lend == REDISMODULE_LIST_HEAD ? -1 : -(count + 1)));
-  RMUTIL_ASSERT_NOERROR(rltrim)
-  RedisModule_ReplyWithCallReply(ctx, rlrange);
+  /* All keys must be empty or lists, checked before popping anything. No
+   * automatic memory: popped elements are released as they are replied. */
+  int nkeys = argc - 2;
+  RedisModuleKey **keys =
+      RedisModule_PoolAlloc(ctx, nkeys * sizeof(RedisModuleKey *));
+  int i;
+  for (i = 0; i < nkeys; i++) {
+    keys[i] = RedisModule_OpenKey(ctx, argv[i + 2],
+                                  REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(keys[i]) != REDISMODULE_KEYTYPE_LIST &&
+        RedisModule_KeyType(keys[i]) != REDISMODULE_KEYTYPE_EMPTY)
+      break;
+  }
+  if (i < nkeys) {
+    for (int j = 0; j <= i; j++) RedisModule_CloseKey(keys[j]);
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  long len = 0;
+  RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+  for (i = 0; i < nkeys; i++) {
+    if (count && RedisModule_ValueLength(keys[i])) {
+      RedisModule_ReplyWithArray(ctx, 2);
+      RedisModule_ReplyWithString(ctx, argv[i + 2]);
+      count -= mpop_reply(ctx, keys[i], REDISMODULE_LIST_HEAD, count);
+      len++;
+    }
+    RedisModule_CloseKey(keys[i]);
+  }
+  RedisModule_ReplySetArrayLength(ctx, len);
+
+  return REDISMODULE_OK;
+}
+
+/*
+* Serves a BLMPOP|BRMPOP from a list if it has elements, replying with the
+* list's name and the popped elements.
+* Returns 1 if the list was served, 0 otherwise.
+*/
+int bmpop_serve(RedisModuleCtx *ctx, RedisModuleString *keyname, int end,
+                long long count) {
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_LIST) {
+    RedisModule_CloseKey(key);
+    return 0;
+  }
+
+  RedisModule_ReplyWithArray(ctx, 2);
+  RedisModule_ReplyWithString(ctx, keyname);
+  mpop_reply(ctx, key, end, count);
+  RedisModule_CloseKey(key);
+  return 1;
+}
+
+/* Returns the end popped from by BLMPOP|BRMPOP. */
+int bmpop_end(RedisModuleString *cmd) {
+  return (strcasecmp(RedisModule_StringPtrLen(cmd, NULL), "brmpop")
+              ? REDISMODULE_LIST_HEAD
+              : REDISMODULE_LIST_TAIL);
+}
+
+/* Called when one of the lists a BLMPOP|BRMPOP is blocked on is pushed to.
+ * The arguments were already validated by the command. */
+int BMPopReply(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  long long count;
+  RedisModule_StringToLongLong(argv[2], &count);
+
+  RedisModuleString *keyname = RedisModule_GetBlockedClientReadyKey(ctx);
+  if (!bmpop_serve(ctx, keyname, bmpop_end(argv[0]), count))
+    return REDISMODULE_ERR;
+  return REDISMODULE_OK;
+}
+
+/* Called when a BLMPOP|BRMPOP times out. */
+int BMPopTimeout(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  return RedisModule_ReplyWithNull(ctx);
+}
+
+/*
+* BLMPOP|BRMPOP timeout count list [list ...]
+* Pops up to 'count' elements from the head or tail of the first list that
+* isn't empty. If all lists are empty, blocks until one of them is pushed to
+* or 'timeout' seconds elapse. A timeout of 0 blocks indefinitely.
+* Note: BRMPOP returns the elements in head-to-tail order.
+* Reply: Array, the list's name and an array of the popped elements, or Null
+* on timeout.
+*/
+int BMPopGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                        int argc) {
+  if (argc < 4) return RedisModule_WrongArity(ctx);
+
+  double timeout;
+  if ((RedisModule_StringToDouble(argv[1], &timeout) != REDISMODULE_OK) ||
+      (timeout < 0)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid timeout");
+    return REDISMODULE_ERR;
+  }
+
+  long long count;
+  if ((RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK) ||
+      (count < 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid count");
+    return REDISMODULE_ERR;
+  }
+
+  /* Keys must be empty or lists. No automatic memory: popped elements are
+   * released as they are replied. */
+  int i;
+  for (i = 3; i < argc; i++) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    RedisModule_CloseKey(key);
+    if (type == REDISMODULE_KEYTYPE_LIST) break;
+    if (type != REDISMODULE_KEYTYPE_EMPTY) {
+      RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+      return REDISMODULE_ERR;
+    }
+  }
+
+  if (i < argc) {
+    bmpop_serve(ctx, argv[i], bmpop_end(argv[0]), count);
+    return REDISMODULE_OK;
+  }
 
+  /* The server signals the keys as ready when they are pushed to. */
+  RedisModule_BlockClientOnKeys(ctx, BMPopReply, BMPopTimeout, NULL,
+                                (long long)(timeout * 1000), &argv[3],
+                                argc - 3, NULL);
   return REDISMODULE_OK;
 }
 
 /*
 * [L|R]PUSHCAPPED key cap ele [ele ...]
 * Pushes elements to list, but trims it from the opposite end to `cap`
-* afterwards if reached.
+* afterwards if reached. Elements that would be trimmed right away aren't
+* pushed at all.
 * Reply: Integer, the list's new length.
 */
 
@@ -295,157 +513,2031 @@ int PushCappedGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
                              int argc) {
   if (argc < 4) return RedisModule_WrongArity(ctx);
 
-  RedisModule_AutoMemory(ctx);
-
   /* Heads or tails? */
   int lend = REDISMODULE_LIST_HEAD;
   const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
   if (!strcasecmp(cmd, "rpushcapped")) lend = REDISMODULE_LIST_TAIL;
 
-  /* Obtain key. */
+  /* Obtain cap. */
+  long long cap;
+  if ((RedisModule_StringToLongLong(argv[2], &cap) != REDISMODULE_OK) ||
+      (cap < 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid cap");
+    return REDISMODULE_ERR;
+  }
+
+  /* Obtain key. No automatic memory: trimmed elements are released as they
+   * are popped. */
   RedisModuleKey *key =
       RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
 
   /* Key must be empty or a list. */
   if ((RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_LIST &&
        RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY)) {
+    RedisModule_CloseKey(key);
     RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
     return REDISMODULE_ERR;
   }
 
-  /* Obtain cap. */
-  long long cap;
-  if ((RedisModule_StringToLongLong(argv[2], &cap) != REDISMODULE_OK) ||
-      (cap < 1)) {
-    RedisModule_ReplyWithError(ctx, "ERR invalid cap");
-    return REDISMODULE_ERR;
-  }
-
-  /* Push elements into the right end of the list. */
-  RedisModuleCallReply *rep =
-      RedisModule_Call(ctx, (lend == REDISMODULE_LIST_HEAD ? "LPUSH" : "RPUSH"),
-                       "sv", argv[1], &argv[3], argc - 3);
-  RMUTIL_ASSERT_NOERROR(rep)
-  long long len = RedisModule_CallReplyInteger(rep);
-
-  /* Trim the right end of the list if reached the cap. */
-  if (len > cap) {
-    RedisModuleCallReply *rltrim =
-        RedisModule_Call(ctx, "LTRIM", "sll", argv[1],
-                         (lend == REDISMODULE_LIST_HEAD ? 0 : -cap),
-                         (lend == REDISMODULE_LIST_HEAD ? cap - 1 : -1));
-    RMUTIL_ASSERT_NOERROR(rltrim)
+  /* Only the last cap elements can survive the trim, so push just these. */
+  int first = (argc - 3 > cap ? argc - cap : 3);
+  for (int i = first; i < argc; i++)
+    RedisModule_ListPush(key, lend, argv[i]);
+
+  /* Trim the other end of the list if reached the cap. */
+  int tend = (lend == REDISMODULE_LIST_HEAD ? REDISMODULE_LIST_TAIL
+                                            : REDISMODULE_LIST_HEAD);
+  size_t len = RedisModule_ValueLength(key);
+  while (len > cap) {
+    RedisModule_FreeString(ctx, RedisModule_ListPop(key, tend));
+    len--;
   }
+  RedisModule_CloseKey(key);
 
   /* Reply with length of list. */
-  key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
-  RedisModule_ReplyWithLongLong(ctx, RedisModule_ValueLength(key));
+  RedisModule_ReplyWithLongLong(ctx, len);
 
   return REDISMODULE_OK;
 }
 
-int testLSplice(RedisModuleCtx *ctx) {
-  RedisModuleCallReply *r;
-
-  r = RedisModule_Call(ctx, "lsplice", "ccc", "src", "dst", "3");
-  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
-  r = RedisModule_Call(ctx, "RPUSH", "cccccc", "src", "1", "2", "3", "a", "b");
-  r = RedisModule_Call(ctx, "lsplice", "ccc", "src", "dst", "2");
-  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
-  r = RedisModule_Call(ctx, "LRANGE", "ccc", "dst", "0", "-1");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "b");
-  r = RedisModule_Call(ctx, "lsplice", "ccc", "src", "dst", "4");
-  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
-  r = RedisModule_Call(ctx, "LRANGE", "ccc", "dst", "0", "-1");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 5);
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "2");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "3");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 3), "a");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 4), "b");
+/* The largest capacity of a ring buffer, as its slots are preallocated. */
+#define RING_MAX_CAP (1 << 24)
+#define RING_ENCODING_VERSION 0
 
-  r = RedisModule_Call(ctx, "FLUSHALL", "");
+/* A ring buffer element. */
+typedef struct {
+  char *buf;
+  size_t len;
+} RingEntry;
 
-  return 0;
+/*
+* A fixed capacity ring buffer of strings, for keeping the last N elements
+* pushed. Its slots are allocated once, and once full every push overwrites
+* the oldest element in place. Elements are ordered from the oldest to the
+* newest.
+*/
+typedef struct {
+  size_t cap;
+  size_t len;
+  size_t head;  /* slot of the oldest element */
+  size_t bytes; /* total length of the elements */
+  RingEntry *slots;
+} Ring;
+
+RedisModuleType *RingType = NULL;
+
+Ring *ring_new(size_t cap) {
+  Ring *r = RedisModule_Calloc(1, sizeof(Ring));
+  r->cap = cap;
+  r->slots = RedisModule_Calloc(cap, sizeof(RingEntry));
+  return r;
 }
 
-int testLPopRPush(RedisModuleCtx *ctx) {
-  RedisModuleCallReply *r;
-
-  r = RedisModule_Call(ctx, "lpoprpush", "cc", "src", "dst");
-  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_NULL);
-  r = RedisModule_Call(ctx, "RPUSH", "cccccc", "src", "1", "2", "3", "a", "b");
-  r = RedisModule_Call(ctx, "lpoprpush", "cc", "src", "dst");
-  RMUtil_AssertReplyEquals(r, "1");
-    r = RedisModule_Call(ctx, "lpoprpush", "cc", "src", "dst");
-  RMUtil_AssertReplyEquals(r, "2");
-  r = RedisModule_Call(ctx, "lpoprpush", "cc", "src", "dst");
-  RMUtil_AssertReplyEquals(r, "3");
-  r = RedisModule_Call(ctx, "LRANGE", "ccc", "src", "0", "-1");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "b");
-  r = RedisModule_Call(ctx, "LRANGE", "ccc", "dst", "0", "-1");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "2");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "3");
+/* Returns the i-th element from the oldest one. */
+RingEntry *ring_at(Ring *r, size_t i) {
+  return &r->slots[(r->head + i) % r->cap];
+}
 
-  r = RedisModule_Call(ctx, "FLUSHALL", "");
+/* Pushes an element, taking ownership of buf, which must have been allocated
+ * with RedisModule_Alloc. If the ring is full the oldest element is freed. */
+void ring_push_buffer(Ring *r, char *buf, size_t len) {
+  RingEntry *e;
+  if (r->len == r->cap) {
+    e = &r->slots[r->head];
+    r->bytes -= e->len;
+    RedisModule_Free(e->buf);
+    r->head = (r->head + 1) % r->cap;
+  } else {
+    e = ring_at(r, r->len++);
+  }
+  e->buf = buf;
+  e->len = len;
+  r->bytes += len;
+}
 
-  return 0;
+void ring_push(Ring *r, const char *str, size_t len) {
+  char *buf = RedisModule_Alloc(len ? len : 1);
+  memcpy(buf, str, len);
+  ring_push_buffer(r, buf, len);
 }
 
-int testLMPop(RedisModuleCtx *ctx) {
-  RedisModuleCallReply *r;
+/* Changes the capacity of a ring, keeping its newest elements. */
+void ring_resize(Ring *r, size_t cap) {
+  RingEntry *slots = RedisModule_Calloc(cap, sizeof(RingEntry));
+  size_t drop = (r->len > cap ? r->len - cap : 0);
+  for (size_t i = 0; i < r->len; i++) {
+    RingEntry *e = ring_at(r, i);
+    if (i < drop) {
+      r->bytes -= e->len;
+      RedisModule_Free(e->buf);
+    } else {
+      slots[i - drop] = *e;
+    }
+  }
+  RedisModule_Free(r->slots);
+  r->slots = slots;
+  r->cap = cap;
+  r->len -= drop;
+  r->head = 0;
+}
 
-  r = RedisModule_Call(ctx, "lmpop", "cc", "list", "42");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 0);
-  r = RedisModule_Call(ctx, "RPUSH", "cccccc", "list", "1", "2", "3", "a", "b");
-  r = RedisModule_Call(ctx, "lmpop", "cc", "list", "3");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "2");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "3");
-  r = RedisModule_Call(ctx, "LRANGE", "ccc", "list", "0", "-1");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "b");
+void RingFree(void *value) {
+  Ring *r = value;
+  for (size_t i = 0; i < r->len; i++) RedisModule_Free(ring_at(r, i)->buf);
+  RedisModule_Free(r->slots);
+  RedisModule_Free(r);
+}
 
-  r = RedisModule_Call(ctx, "FLUSHALL", "");
+size_t RingMemUsage(const void *value) {
+  const Ring *r = value;
+  return sizeof(Ring) + r->cap * sizeof(RingEntry) + r->bytes;
+}
 
-  return 0;
+void RingRdbSave(RedisModuleIO *rdb, void *value) {
+  Ring *r = value;
+  RedisModule_SaveUnsigned(rdb, r->cap);
+  RedisModule_SaveUnsigned(rdb, r->len);
+  for (size_t i = 0; i < r->len; i++) {
+    RingEntry *e = ring_at(r, i);
+    RedisModule_SaveStringBuffer(rdb, e->buf, e->len);
+  }
 }
 
-int testLPushCapped(RedisModuleCtx *ctx) {
-  RedisModuleCallReply *r;
+void *RingRdbLoad(RedisModuleIO *rdb, int encver) {
+  if (encver != RING_ENCODING_VERSION) return NULL;
 
-  r = RedisModule_Call(ctx, "lpushcapped", "ccc", "list", "3", "1");
-  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
-  r = RedisModule_Call(ctx, "lpushcapped", "ccc", "list", "3", "2");
-  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);  
-  r = RedisModule_Call(ctx, "lpushcapped", "ccc", "list", "3", "3");
-  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
-  r = RedisModule_Call(ctx, "lpushcapped", "ccc", "list", "3", "4");
-  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
-  r = RedisModule_Call(ctx, "LRANGE", "ccc", "list", "0", "-1");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "4");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "3");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "2");
-  r = RedisModule_Call(ctx, "lpushcapped", "ccccc", "list", "3", "5", "6", "7");
-  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
-  r = RedisModule_Call(ctx, "LRANGE", "ccc", "list", "0", "-1");
-  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "7");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "6");
-  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "5");
-  
-  r = RedisModule_Call(ctx, "FLUSHALL", "");
+  Ring *r = ring_new(RedisModule_LoadUnsigned(rdb));
+  size_t len = RedisModule_LoadUnsigned(rdb);
+  while (len--) {
+    size_t elen;
+    char *buf = RedisModule_LoadStringBuffer(rdb, &elen);
+    ring_push_buffer(r, buf, elen);
+  }
+  return r;
+}
 
-  return 0;
+void RingAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+  Ring *r = value;
+  for (size_t i = 0; i < r->len; i++) {
+    RingEntry *e = ring_at(r, i);
+    RedisModule_EmitAOF(aof, "RING.PUSH", "slb", key, (long long)r->cap,
+                        e->buf, e->len);
+  }
+}
+
+/* Parses a ring buffer capacity, replying with an error if it's invalid. */
+int ring_parse_cap(RedisModuleCtx *ctx, RedisModuleString *arg, size_t *cap) {
+  long long lcap;
+  if ((RedisModule_StringToLongLong(arg, &lcap) != REDISMODULE_OK) ||
+      (lcap < 1) || (lcap > RING_MAX_CAP)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid cap");
+    return REDISMODULE_ERR;
+  }
+  *cap = lcap;
+  return REDISMODULE_OK;
+}
+
+/*
+* RING.PUSH key cap ele [ele ...]
+* Pushes elements to a ring buffer of capacity `cap`, creating it if needed.
+* Once full, each push overwrites the oldest element. A different `cap`
+* resizes the ring, keeping its newest elements.
+* Reply: Integer, the ring's new length.
+*/
+int RingPushCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 4) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  size_t cap;
+  if (ring_parse_cap(ctx, argv[2], &cap) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, RingType);
+  if (!key) return REDISMODULE_ERR;
+  Ring *r = RedisModule_ModuleTypeGetValue(key);
+
+  if (!r) {
+    r = ring_new(cap);
+    RedisModule_ModuleTypeSetValue(key, RingType, r);
+  } else if (r->cap != cap) {
+    ring_resize(r, cap);
+  }
+
+  /* Only the last cap elements would survive. */
+  int first = (argc - 3 > (long long)cap ? argc - cap : 3);
+  for (int i = first; i < argc; i++) {
+    size_t len;
+    const char *ele = RedisModule_StringPtrLen(argv[i], &len);
+    ring_push(r, ele, len);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, r->len);
+  return REDISMODULE_OK;
+}
+
+/*
+* RING.RANGE key start stop
+* Returns the elements of a ring buffer between the `start` and `stop`
+* offsets, inclusive, where 0 is the oldest element. Negative offsets count
+* from the newest element, as in LRANGE.
+* Reply: Array of elements, from the oldest to the newest.
+*/
+int RingRangeCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                     int argc) {
+  if (argc != 4) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  long long start, stop;
+  if ((RedisModule_StringToLongLong(argv[2], &start) != REDISMODULE_OK) ||
+      (RedisModule_StringToLongLong(argv[3], &stop) != REDISMODULE_OK)) {
+    RedisModule_ReplyWithError(ctx,
+                               "ERR value is not an integer or out of range");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key =
+      RMUtil_OpenModuleKey(ctx, argv[1], REDISMODULE_READ, RingType);
+  if (!key) return REDISMODULE_ERR;
+  Ring *r = RedisModule_ModuleTypeGetValue(key);
+
+  long long len = (r ? r->len : 0);
+  if (start < 0) start += len;
+  if (stop < 0) stop += len;
+  if (start < 0) start = 0;
+  if (stop >= len) stop = len - 1;
+  if (start > stop) {
+    RedisModule_ReplyWithArray(ctx, 0);
+    return REDISMODULE_OK;
+  }
+
+  RedisModule_ReplyWithArray(ctx, stop - start + 1);
+  for (long long i = start; i <= stop; i++) {
+    RingEntry *e = ring_at(r, i);
+    RedisModule_ReplyWithStringBuffer(ctx, e->buf, e->len);
+  }
+  return REDISMODULE_OK;
+}
+
+/*
+* RING.LEN key
+* Reply: Integer, the number of elements in the ring buffer.
+*/
+int RingLenCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key =
+      RMUtil_OpenModuleKey(ctx, argv[1], REDISMODULE_READ, RingType);
+  if (!key) return REDISMODULE_ERR;
+  Ring *r = RedisModule_ModuleTypeGetValue(key);
+
+  RedisModule_ReplyWithLongLong(ctx, r ? r->len : 0);
+  return REDISMODULE_OK;
+}
+
+/*
+* RING.FROMLIST key cap [HEAD|TAIL]
+* Converts a list, such as one maintained by [L|R]PUSHCAPPED, to a ring buffer
+* of capacity `cap` in place, keeping its newest elements. The optional
+* argument is the end of the list its newest elements are at: `HEAD` for
+* LPUSHCAPPED and `TAIL` (the default) for RPUSHCAPPED.
+* Reply: Integer, the ring's length.
+*/
+int RingFromListCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                        int argc) {
+  if (argc != 3 && argc != 4) return RedisModule_WrongArity(ctx);
+
+  size_t cap;
+  if (ring_parse_cap(ctx, argv[2], &cap) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+
+  /* Pop from the end with the oldest elements. */
+  int lend = REDISMODULE_LIST_HEAD;
+  if (argc == 4) {
+    const char *end = RedisModule_StringPtrLen(argv[3], NULL);
+    if (!strcasecmp("head", end))
+      lend = REDISMODULE_LIST_TAIL;
+    else if (strcasecmp("tail", end)) {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
+    }
+  }
+
+  /* No automatic memory: popped elements are released as they go. */
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_LIST) {
+    RedisModule_CloseKey(key);
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  Ring *r = ring_new(cap);
+  RedisModuleString *ele;
+  while ((ele = RedisModule_ListPop(key, lend)) != NULL) {
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(ele, &len);
+    ring_push(r, str, len);
+    RedisModule_FreeString(ctx, ele);
+  }
+  RedisModule_ModuleTypeSetValue(key, RingType, r);
+  RedisModule_CloseKey(key);
+
+  RedisModule_ReplyWithLongLong(ctx, r->len);
+  return REDISMODULE_OK;
+}
+
+#define QUEUE_ENCODING_VERSION 0
+
+/* A reliable queue item. */
+typedef struct {
+  uint64_t id;        /* delivery id, while in flight */
+  long long deadline; /* redelivery time, while in flight */
+  char *buf;
+  size_t len;
+} QueueItem;
+
+/* An in flight item's redelivery time. */
+typedef struct {
+  long long deadline;
+  uint64_t id;
+} QueueTimeout;
+
+/*
+* A reliable queue. Ready items wait in a FIFO. Popped items stay in flight,
+* indexed by their delivery id, until they are acked or their visibility
+* timeout expires, in which case they are redelivered first. Timeouts are
+* kept in a heap by deadline, so redelivery costs O(expired). Acked items'
+* timeouts are dropped lazily.
+*/
+typedef struct {
+  uint64_t nextid;
+  QueueItem **ready; /* circular buffer */
+  size_t head, len, cap;
+  HashMap *inflight;
+  PriorityQueue *timeouts;
+} Queue;
+
+RedisModuleType *QueueType = NULL;
+
+/* Orders timeouts so the earliest deadline is on top of the heap. */
+int queue_timeout_cmp(void *e1, void *e2) {
+  QueueTimeout *t1 = e1, *t2 = e2;
+  return (t1->deadline < t2->deadline ? 1
+                                      : (t1->deadline > t2->deadline ? -1 : 0));
+}
+
+/* Schedules the redelivery of an in flight item. */
+void queue_timeout_push(Queue *q, long long deadline, uint64_t id) {
+  QueueTimeout t = {deadline, id};
+  __priority_Queue_PushPtr(q->timeouts, &t);
+}
+
+Queue *queue_new() {
+  Queue *q = RedisModule_Calloc(1, sizeof(Queue));
+  q->nextid = 1;
+  q->inflight = NewHashMap(16);
+  q->timeouts = NewPriorityQueue(QueueTimeout, 16, queue_timeout_cmp);
+  return q;
+}
+
+QueueItem *queue_item_new(const char *str, size_t len) {
+  QueueItem *item = RedisModule_Calloc(1, sizeof(QueueItem));
+  item->buf = RedisModule_Alloc(len ? len : 1);
+  memcpy(item->buf, str, len);
+  item->len = len;
+  return item;
+}
+
+void queue_item_free(void *item) {
+  RedisModule_Free(((QueueItem *)item)->buf);
+  RedisModule_Free(item);
+}
+
+/* Adds a ready item at the back, or at the front for redeliveries. */
+void queue_push(Queue *q, QueueItem *item, int front) {
+  if (q->len == q->cap) {
+    size_t cap = (q->cap ? q->cap * 2 : 16);
+    QueueItem **ready = RedisModule_Alloc(cap * sizeof(QueueItem *));
+    for (size_t i = 0; i < q->len; i++)
+      ready[i] = q->ready[(q->head + i) % q->cap];
+    RedisModule_Free(q->ready);
+    q->ready = ready;
+    q->cap = cap;
+    q->head = 0;
+  }
+  if (front) {
+    q->head = (q->head + q->cap - 1) % q->cap;
+    q->ready[q->head] = item;
+  } else {
+    q->ready[(q->head + q->len) % q->cap] = item;
+  }
+  q->len++;
+}
+
+QueueItem *queue_pop(Queue *q) {
+  if (!q->len) return NULL;
+  QueueItem *item = q->ready[q->head];
+  q->head = (q->head + 1) % q->cap;
+  q->len--;
+  return item;
+}
+
+/* Puts an item in flight until deadline, under a new delivery id. */
+void queue_deliver(Queue *q, QueueItem *item, long long deadline) {
+  item->id = q->nextid++;
+  item->deadline = deadline;
+  HashMap_Put(q->inflight, (char *)&item->id, sizeof(item->id), item);
+  queue_timeout_push(q, deadline, item->id);
+}
+
+/* Rebuilds the timeouts heap when it's mostly made of acked items. */
+void queue_compact(Queue *q) {
+  if (Priority_Queue_Size(q->timeouts) <= 2 * HashMap_Size(q->inflight) + 64)
+    return;
+
+  Priority_Queue_Free(q->timeouts);
+  q->timeouts = NewPriorityQueue(QueueTimeout, 16, queue_timeout_cmp);
+  HashMapIterator it = HashMap_Iterate(q->inflight);
+  HashMapEntry *e;
+  while ((e = HashMapIterator_Next(&it))) {
+    QueueItem *item = e->value;
+    queue_timeout_push(q, item->deadline, item->id);
+  }
+}
+
+/* Moves the in flight items whose visibility timeout expired by now back to
+ * the front of the queue, the earliest expired first. */
+void queue_expire(Queue *q, long long now) {
+  Vector *expired = NULL;
+  QueueTimeout t;
+  while (Priority_Queue_Top(q->timeouts, &t) && t.deadline <= now) {
+    Priority_Queue_Pop(q->timeouts);
+    void *item;
+    if (!HashMap_Delete(q->inflight, (char *)&t.id, sizeof(t.id), &item))
+      continue;
+    if (!expired) expired = NewVector(QueueItem *, 16);
+    Vector_Push(expired, (QueueItem *)item);
+  }
+  if (!expired) return;
+
+  for (int i = Vector_Size(expired) - 1; i >= 0; i--) {
+    QueueItem *item;
+    Vector_Get(expired, i, &item);
+    queue_push(q, item, 1);
+  }
+  Vector_Free(expired);
+}
+
+void QueueFree(void *value) {
+  Queue *q = value;
+  QueueItem *item;
+  while ((item = queue_pop(q))) queue_item_free(item);
+  RedisModule_Free(q->ready);
+  HashMap_Free(q->inflight, queue_item_free);
+  Priority_Queue_Free(q->timeouts);
+  RedisModule_Free(q);
+}
+
+size_t QueueMemUsage(const void *value) {
+  const Queue *q = value;
+  size_t size = sizeof(Queue) + q->cap * sizeof(QueueItem *) +
+                q->timeouts->v->cap * sizeof(QueueTimeout);
+  for (size_t i = 0; i < q->len; i++)
+    size += sizeof(QueueItem) + q->ready[(q->head + i) % q->cap]->len;
+  HashMapIterator it = HashMap_Iterate(q->inflight);
+  HashMapEntry *e;
+  while ((e = HashMapIterator_Next(&it)))
+    size += sizeof(HashMapEntry) + e->keylen + sizeof(QueueItem) +
+            ((QueueItem *)e->value)->len;
+  return size;
+}
+
+void QueueRdbSave(RedisModuleIO *rdb, void *value) {
+  Queue *q = value;
+  RedisModule_SaveUnsigned(rdb, q->nextid);
+  RedisModule_SaveUnsigned(rdb, q->len);
+  for (size_t i = 0; i < q->len; i++) {
+    QueueItem *item = q->ready[(q->head + i) % q->cap];
+    RedisModule_SaveStringBuffer(rdb, item->buf, item->len);
+  }
+  RedisModule_SaveUnsigned(rdb, HashMap_Size(q->inflight));
+  HashMapIterator it = HashMap_Iterate(q->inflight);
+  HashMapEntry *e;
+  while ((e = HashMapIterator_Next(&it))) {
+    QueueItem *item = e->value;
+    RedisModule_SaveUnsigned(rdb, item->id);
+    RedisModule_SaveSigned(rdb, item->deadline);
+    RedisModule_SaveStringBuffer(rdb, item->buf, item->len);
+  }
+}
+
+void *QueueRdbLoad(RedisModuleIO *rdb, int encver) {
+  if (encver != QUEUE_ENCODING_VERSION) return NULL;
+
+  Queue *q = queue_new();
+  q->nextid = RedisModule_LoadUnsigned(rdb);
+  size_t len = RedisModule_LoadUnsigned(rdb);
+  while (len--) {
+    QueueItem *item = RedisModule_Calloc(1, sizeof(QueueItem));
+    item->buf = RedisModule_LoadStringBuffer(rdb, &item->len);
+    queue_push(q, item, 0);
+  }
+  len = RedisModule_LoadUnsigned(rdb);
+  while (len--) {
+    QueueItem *item = RedisModule_Calloc(1, sizeof(QueueItem));
+    item->id = RedisModule_LoadUnsigned(rdb);
+    item->deadline = RedisModule_LoadSigned(rdb);
+    item->buf = RedisModule_LoadStringBuffer(rdb, &item->len);
+    HashMap_Put(q->inflight, (char *)&item->id, sizeof(item->id), item);
+    queue_timeout_push(q, item->deadline, item->id);
+  }
+  return q;
+}
+
+/* In flight items are rewritten as ready ones. */
+void QueueAofRewrite(RedisModuleIO *aof, RedisModuleString *key,
+                     void *value) {
+  Queue *q = value;
+  for (size_t i = 0; i < q->len; i++) {
+    QueueItem *item = q->ready[(q->head + i) % q->cap];
+    RedisModule_EmitAOF(aof, "Q.PUSH", "sb", key, item->buf, item->len);
+  }
+  HashMapIterator it = HashMap_Iterate(q->inflight);
+  HashMapEntry *e;
+  while ((e = HashMapIterator_Next(&it))) {
+    QueueItem *item = e->value;
+    RedisModule_EmitAOF(aof, "Q.PUSH", "sb", key, item->buf, item->len);
+  }
+}
+
+/*
+* Q.PUSH key ele [ele ...]
+* Pushes elements to the back of a reliable queue, creating it if needed.
+* Reply: Integer, the number of items in the queue that aren't acked.
+*/
+int QPushCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, QueueType);
+  if (!key) return REDISMODULE_ERR;
+  Queue *q = RedisModule_ModuleTypeGetValue(key);
+
+  if (!q) {
+    q = queue_new();
+    RedisModule_ModuleTypeSetValue(key, QueueType, q);
+  }
+  for (int i = 2; i < argc; i++) {
+    size_t len;
+    const char *ele = RedisModule_StringPtrLen(argv[i], &len);
+    queue_push(q, queue_item_new(ele, len), 0);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, q->len + HashMap_Size(q->inflight));
+  return REDISMODULE_OK;
+}
+
+/*
+* Q.POP key count visibility
+* Pops up to `count` items from the front of a reliable queue. Popped items
+* stay in flight for `visibility` milliseconds: unless acked by then, they are
+* redelivered ahead of the other items.
+* Reply: Array of pairs, each an item's delivery id and its element.
+*/
+int QPopCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 4) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  long long count, visibility;
+  if ((RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK) ||
+      (count < 0)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid count");
+    return REDISMODULE_ERR;
+  }
+  if ((RedisModule_StringToLongLong(argv[3], &visibility) != REDISMODULE_OK) ||
+      (visibility < 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid visibility timeout");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, QueueType);
+  if (!key) return REDISMODULE_ERR;
+  Queue *q = RedisModule_ModuleTypeGetValue(key);
+  if (!q) {
+    RedisModule_ReplyWithArray(ctx, 0);
+    return REDISMODULE_OK;
+  }
+
+  long long now = RedisModule_Milliseconds();
+  queue_expire(q, now);
+
+  if ((size_t)count > q->len) count = q->len;
+  RedisModule_ReplyWithArray(ctx, count);
+  while (count--) {
+    QueueItem *item = queue_pop(q);
+    queue_deliver(q, item, now + visibility);
+    RedisModule_ReplyWithArray(ctx, 2);
+    RedisModule_ReplyWithLongLong(ctx, item->id);
+    RedisModule_ReplyWithStringBuffer(ctx, item->buf, item->len);
+  }
+
+  return REDISMODULE_OK;
+}
+
+/*
+* Q.ACK key id [id ...]
+* Acknowledges in flight items by their delivery ids, removing them from the
+* queue for good. Ids of items that were redelivered since are ignored.
+* Reply: Integer, the number of items acked.
+*/
+int QAckCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, QueueType);
+  if (!key) return REDISMODULE_ERR;
+  Queue *q = RedisModule_ModuleTypeGetValue(key);
+
+  long long acked = 0;
+  for (int i = 2; q && i < argc; i++) {
+    long long lid;
+    if (RedisModule_StringToLongLong(argv[i], &lid) != REDISMODULE_OK)
+      continue;
+    uint64_t id = lid;
+    void *item;
+    if (HashMap_Delete(q->inflight, (char *)&id, sizeof(id), &item)) {
+      queue_item_free(item);
+      acked++;
+    }
+  }
+
+  if (q) {
+    if (!q->len && !HashMap_Size(q->inflight))
+      RedisModule_DeleteKey(key);
+    else
+      queue_compact(q);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, acked);
+  return REDISMODULE_OK;
+}
+
+/*
+* Q.LEN key
+* Reply: Integer, the number of items in the queue that aren't acked, both
+* ready and in flight.
+*/
+int QLenCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key =
+      RMUtil_OpenModuleKey(ctx, argv[1], REDISMODULE_READ, QueueType);
+  if (!key) return REDISMODULE_ERR;
+  Queue *q = RedisModule_ModuleTypeGetValue(key);
+
+  RedisModule_ReplyWithLongLong(ctx,
+                                q ? q->len + HashMap_Size(q->inflight) : 0);
+  return REDISMODULE_OK;
+}
+
+/* What a timer needs to find its key back. */
+typedef struct {
+  int db;
+  size_t len;
+  char name[];
+} KeyTimer;
+
+KeyTimer *keytimer_new(RedisModuleCtx *ctx, RedisModuleString *keyname) {
+  size_t len;
+  const char *name = RedisModule_StringPtrLen(keyname, &len);
+  KeyTimer *t = RedisModule_Alloc(sizeof(KeyTimer) + len);
+  t->db = RedisModule_GetSelectedDb(ctx);
+  t->len = len;
+  memcpy(t->name, name, len);
+  return t;
+}
+
+/* Selects the timer's database and returns its key's name. The timer is
+ * released. */
+RedisModuleString *keytimer_keyname(RedisModuleCtx *ctx, KeyTimer *t) {
+  RedisModule_SelectDb(ctx, t->db);
+  RedisModuleString *keyname = RedisModule_CreateString(ctx, t->name, t->len);
+  RedisModule_Free(t);
+  return keyname;
+}
+
+/* Returns 1 if a timer armed for time 'at' with data t is still pending for
+ * keyname in the selected database. Once its time has passed the timer may
+ * already have fired and released t, and after a RENAME or MOVE it fires on
+ * the old name, so either way it can't be relied on anymore. */
+int keytimer_pending(RedisModuleCtx *ctx, KeyTimer *t, long long at,
+                     RedisModuleString *keyname) {
+  if (!at || at <= RedisModule_Milliseconds()) return 0;
+
+  size_t len;
+  const char *name = RedisModule_StringPtrLen(keyname, &len);
+  return (t->db == RedisModule_GetSelectedDb(ctx) && t->len == len &&
+          !memcmp(t->name, name, len));
+}
+
+#define DELAYQUEUE_ENCODING_VERSION 0
+
+/* A delayed item. Its payload is stored in the queue's arena. */
+typedef struct {
+  long long readyat;
+  uint64_t seq; /* keeps items that are ready at the same time in order */
+  size_t off;
+  size_t len;
+} DelayQueueEntry;
+
+/*
+* A delayed queue: items become ready at a given time and are popped in that
+* order. Items sit in a priority queue and their payloads are appended to a
+* single arena, which is compacted once it is mostly made of popped payloads.
+* A timer is kept armed for the time the head item becomes ready, to wake the
+* clients blocked on the queue.
+*/
+typedef struct {
+  PriorityQueue *items;
+  char *arena;
+  size_t used, cap, live;
+  uint64_t seq;
+  RedisModuleTimerID timer;
+  long long timerat; /* 0 when no timer is armed */
+  KeyTimer *timerkey;
+} DelayQueue;
+
+RedisModuleType *DelayQueueType = NULL;
+
+/* Orders items so the first one to be ready is on top of the heap. */
+int dq_entry_cmp(void *e1, void *e2) {
+  DelayQueueEntry *d1 = e1, *d2 = e2;
+  if (d1->readyat != d2->readyat) return (d1->readyat < d2->readyat ? 1 : -1);
+  return (d1->seq < d2->seq ? 1 : (d1->seq > d2->seq ? -1 : 0));
+}
+
+DelayQueue *dq_new() {
+  DelayQueue *q = RedisModule_Calloc(1, sizeof(DelayQueue));
+  q->items = NewPriorityQueue(DelayQueueEntry, 16, dq_entry_cmp);
+  return q;
+}
+
+/* Moves the live payloads to a new arena, in place of the old one. */
+void dq_compact(DelayQueue *q, size_t cap) {
+  char *arena = RedisModule_Alloc(cap);
+  size_t used = 0;
+  Vector *v = q->items->v;
+  for (size_t i = 0; i < v->top; i++) {
+    DelayQueueEntry *e = (DelayQueueEntry *)(v->data + i * v->elemSize);
+    memcpy(arena + used, q->arena + e->off, e->len);
+    e->off = used;
+    used += e->len;
+  }
+  RedisModule_Free(q->arena);
+  q->arena = arena;
+  q->cap = cap;
+  q->used = used;
+}
+
+void dq_add(DelayQueue *q, long long readyat, const char *payload,
+            size_t len) {
+  if (q->used + len > q->cap) {
+    /* Leave at least half of the arena free after compacting it, growing
+     * it if needed, so compactions are amortized over the adds. */
+    size_t cap = (q->cap ? q->cap : 256);
+    while (cap < 2 * (q->live + len)) cap *= 2;
+    dq_compact(q, cap);
+  }
+
+  DelayQueueEntry e = {readyat, q->seq++, q->used, len};
+  memcpy(q->arena + q->used, payload, len);
+  q->used += len;
+  q->live += len;
+  __priority_Queue_PushPtr(q->items, &e);
+}
+
+/* Returns the head item, or NULL if the queue is empty. */
+DelayQueueEntry *dq_head(DelayQueue *q) {
+  if (!Priority_Queue_Size(q->items)) return NULL;
+  return (DelayQueueEntry *)q->items->v->data;
+}
+
+/* Removes the head item. Its payload stays valid until the next add. */
+void dq_pop(DelayQueue *q) {
+  q->live -= dq_head(q)->len;
+  Priority_Queue_Pop(q->items);
+  if (!Priority_Queue_Size(q->items)) q->used = 0;
+}
+
+void DelayQueueTimerHandler(RedisModuleCtx *ctx, void *data);
+
+/* Makes sure a timer is armed for when the head item becomes ready, if it
+ * isn't already. */
+void dq_arm(RedisModuleCtx *ctx, DelayQueue *q, RedisModuleString *keyname) {
+  if (!RedisModule_CreateTimer) return;
+
+  DelayQueueEntry *head = dq_head(q);
+  long long now = RedisModule_Milliseconds();
+  if (!head || head->readyat <= now) return;
+  if (keytimer_pending(ctx, q->timerkey, q->timerat, keyname) &&
+      q->timerat <= head->readyat)
+    return;
+
+  void *data;
+  if (q->timerat && RedisModule_StopTimer(ctx, q->timer, &data) ==
+                        REDISMODULE_OK)
+    RedisModule_Free(data);
+
+  q->timerkey = keytimer_new(ctx, keyname);
+  q->timer = RedisModule_CreateTimer(ctx, head->readyat - now,
+                                     DelayQueueTimerHandler, q->timerkey);
+  q->timerat = head->readyat;
+}
+
+/* Wakes the clients blocked on a delayed queue once its head is ready. The
+ * queue may have been deleted or replaced since the timer was armed. */
+void DelayQueueTimerHandler(RedisModuleCtx *ctx, void *data) {
+  RedisModuleString *keyname = keytimer_keyname(ctx, data);
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+  if (RedisModule_ModuleTypeGetType(key) == DelayQueueType) {
+    DelayQueue *q = RedisModule_ModuleTypeGetValue(key);
+    q->timerat = 0;
+    DelayQueueEntry *head = dq_head(q);
+    if (head && head->readyat <= RedisModule_Milliseconds())
+      RedisModule_SignalKeyAsReady(ctx, keyname);
+    else
+      dq_arm(ctx, q, keyname);
+  }
+  RedisModule_CloseKey(key);
+  RedisModule_FreeString(ctx, keyname);
+}
+
+void DelayQueueFree(void *value) {
+  DelayQueue *q = value;
+  Priority_Queue_Free(q->items);
+  RedisModule_Free(q->arena);
+  RedisModule_Free(q);
+}
+
+size_t DelayQueueMemUsage(const void *value) {
+  const DelayQueue *q = value;
+  return sizeof(DelayQueue) + q->cap +
+         q->items->v->cap * sizeof(DelayQueueEntry);
+}
+
+void DelayQueueRdbSave(RedisModuleIO *rdb, void *value) {
+  DelayQueue *q = value;
+  Vector *v = q->items->v;
+  RedisModule_SaveUnsigned(rdb, q->seq);
+  RedisModule_SaveUnsigned(rdb, v->top);
+  for (size_t i = 0; i < v->top; i++) {
+    DelayQueueEntry *e = (DelayQueueEntry *)(v->data + i * v->elemSize);
+    RedisModule_SaveSigned(rdb, e->readyat);
+    RedisModule_SaveUnsigned(rdb, e->seq);
+    RedisModule_SaveStringBuffer(rdb, q->arena + e->off, e->len);
+  }
+}
+
+void *DelayQueueRdbLoad(RedisModuleIO *rdb, int encver) {
+  if (encver != DELAYQUEUE_ENCODING_VERSION) return NULL;
+
+  DelayQueue *q = dq_new();
+  uint64_t seq = RedisModule_LoadUnsigned(rdb);
+  size_t len = RedisModule_LoadUnsigned(rdb);
+  while (len--) {
+    long long readyat = RedisModule_LoadSigned(rdb);
+    q->seq = RedisModule_LoadUnsigned(rdb);
+    size_t plen;
+    char *payload = RedisModule_LoadStringBuffer(rdb, &plen);
+    dq_add(q, readyat, payload, plen);
+    RedisModule_Free(payload);
+  }
+  q->seq = seq;
+  return q;
+}
+
+void DelayQueueAofRewrite(RedisModuleIO *aof, RedisModuleString *key,
+                          void *value) {
+  DelayQueue *q = value;
+  Vector *v = q->items->v;
+  for (size_t i = 0; i < v->top; i++) {
+    DelayQueueEntry *e = (DelayQueueEntry *)(v->data + i * v->elemSize);
+    RedisModule_EmitAOF(aof, "DQ.ADD", "slb", key, e->readyat,
+                        q->arena + e->off, e->len);
+  }
+}
+
+/* Pops up to count ready items and replies with their payloads. Returns the
+ * number of items popped. */
+long long dq_pop_ready(RedisModuleCtx *ctx, RedisModuleKey *key,
+                       DelayQueue *q, long long count) {
+  long long now = RedisModule_Milliseconds();
+  long long len = 0;
+  RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+  DelayQueueEntry *head;
+  while (len < count && (head = dq_head(q)) && head->readyat <= now) {
+    RedisModule_ReplyWithStringBuffer(ctx, q->arena + head->off, head->len);
+    dq_pop(q);
+    len++;
+  }
+  RedisModule_ReplySetArrayLength(ctx, len);
+
+  if (!dq_head(q)) RedisModule_DeleteKey(key);
+  return len;
+}
+
+/*
+* DQ.ADD key ready-at payload [ready-at payload ...]
+* Adds payloads to a delayed queue, creating it if needed. Each becomes ready
+* to be popped at the `ready-at` Unix time, in milliseconds.
+* Reply: Integer, the number of items in the queue.
+*/
+int DQAddCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if ((argc < 4) || (argc % 2 != 0)) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  for (int i = 2; i < argc; i += 2) {
+    long long readyat;
+    if (RedisModule_StringToLongLong(argv[i], &readyat) != REDISMODULE_OK) {
+      RedisModule_ReplyWithError(ctx, "ERR invalid ready-at time");
+      return REDISMODULE_ERR;
+    }
+  }
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, DelayQueueType);
+  if (!key) return REDISMODULE_ERR;
+  DelayQueue *q = RedisModule_ModuleTypeGetValue(key);
+
+  if (!q) {
+    q = dq_new();
+    RedisModule_ModuleTypeSetValue(key, DelayQueueType, q);
+  }
+  long long now = RedisModule_Milliseconds();
+  int ready = 0;
+  for (int i = 2; i < argc; i += 2) {
+    long long readyat;
+    size_t len;
+    RedisModule_StringToLongLong(argv[i], &readyat);
+    const char *payload = RedisModule_StringPtrLen(argv[i + 1], &len);
+    dq_add(q, readyat, payload, len);
+    ready |= (readyat <= now);
+  }
+
+  /* Wake blocked clients now, or once the head is ready. */
+  if (ready && RedisModule_SignalKeyAsReady)
+    RedisModule_SignalKeyAsReady(ctx, argv[1]);
+  dq_arm(ctx, q, argv[1]);
+
+  RedisModule_ReplyWithLongLong(ctx, Priority_Queue_Size(q->items));
+  return REDISMODULE_OK;
+}
+
+/*
+* DQ.POPREADY key count
+* Pops up to `count` items that are ready from a delayed queue, the earliest
+* ready first.
+* Reply: Array of payloads.
+*/
+int DQPopReadyCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
+  if (argc != 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  long long count;
+  if ((RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK) ||
+      (count < 0)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid count");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, DelayQueueType);
+  if (!key) return REDISMODULE_ERR;
+  DelayQueue *q = RedisModule_ModuleTypeGetValue(key);
+  if (!q) {
+    RedisModule_ReplyWithArray(ctx, 0);
+    return REDISMODULE_OK;
+  }
+
+  dq_pop_ready(ctx, key, q, count);
+  return REDISMODULE_OK;
+}
+
+/* Called when a delayed queue a DQ.BPOPREADY is blocked on may have ready
+ * items. The arguments were already validated by the command. */
+int DQBPopReadyReply(RedisModuleCtx *ctx, RedisModuleString **argv,
+                     int argc) {
+  RedisModule_AutoMemory(ctx);
+
+  long long count;
+  RedisModule_StringToLongLong(argv[2], &count);
+
+  DelayQueue *q;
+  RedisModuleString *keyname = RedisModule_GetBlockedClientReadyKey(ctx);
+  RedisModuleKey *key = RedisModule_OpenKey(
+      ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+  if (RedisModule_ModuleTypeGetType(key) != DelayQueueType)
+    return REDISMODULE_ERR;
+  q = RedisModule_ModuleTypeGetValue(key);
+
+  DelayQueueEntry *head = dq_head(q);
+  if (!head || head->readyat > RedisModule_Milliseconds()) {
+    dq_arm(ctx, q, keyname);
+    return REDISMODULE_ERR;
+  }
+
+  dq_pop_ready(ctx, key, q, count);
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY)
+    dq_arm(ctx, q, keyname);
+  return REDISMODULE_OK;
+}
+
+/* Called when a DQ.BPOPREADY times out. */
+int DQBPopReadyTimeout(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc) {
+  return RedisModule_ReplyWithNull(ctx);
+}
+
+/*
+* DQ.BPOPREADY key count timeout
+* Like DQ.POPREADY, but if no item is ready, blocks until one is or `timeout`
+* seconds elapse. A timeout of 0 blocks indefinitely. Clients are woken by a
+* timer armed for when the queue's head becomes ready, without polling.
+* Reply: Array of payloads, or Null on timeout.
+*/
+int DQBPopReadyCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc) {
+  if (argc != 4) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  long long count;
+  if ((RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK) ||
+      (count < 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid count");
+    return REDISMODULE_ERR;
+  }
+  double timeout;
+  if ((RedisModule_StringToDouble(argv[3], &timeout) != REDISMODULE_OK) ||
+      (timeout < 0)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid timeout");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, DelayQueueType);
+  if (!key) return REDISMODULE_ERR;
+  DelayQueue *q = RedisModule_ModuleTypeGetValue(key);
+
+  DelayQueueEntry *head = (q ? dq_head(q) : NULL);
+  if (head && head->readyat <= RedisModule_Milliseconds()) {
+    dq_pop_ready(ctx, key, q, count);
+    return REDISMODULE_OK;
+  }
+
+  if (q) dq_arm(ctx, q, argv[1]);
+  RedisModule_BlockClientOnKeys(ctx, DQBPopReadyReply, DQBPopReadyTimeout,
+                                NULL, (long long)(timeout * 1000), &argv[1], 1,
+                                NULL);
+  return REDISMODULE_OK;
+}
+
+#define UNIQUELIST_ENCODING_VERSION 0
+
+/*
+* A list without duplicates. Its elements are the keys of a hash map, which
+* makes membership checks O(1), and the list itself is a circular buffer of
+* pointers to the map's entries, from the head to the tail.
+*/
+typedef struct {
+  HashMap *members;
+  HashMapEntry **elems;
+  size_t head, len, cap;
+} UniqueList;
+
+RedisModuleType *UniqueListType = NULL;
+
+UniqueList *ulist_new() {
+  UniqueList *l = RedisModule_Calloc(1, sizeof(UniqueList));
+  l->members = NewHashMap(16);
+  return l;
+}
+
+/* Pushes an element unless it's already in the list. Returns 1 if it was
+ * pushed, 0 otherwise. */
+int ulist_push(UniqueList *l, const char *ele, size_t len, int end) {
+  int added;
+  HashMapEntry *e = HashMap_Insert(l->members, ele, len, &added);
+  if (!added) return 0;
+
+  if (l->len == l->cap) {
+    size_t cap = (l->cap ? l->cap * 2 : 16);
+    HashMapEntry **elems = RedisModule_Alloc(cap * sizeof(HashMapEntry *));
+    for (size_t i = 0; i < l->len; i++)
+      elems[i] = l->elems[(l->head + i) % l->cap];
+    RedisModule_Free(l->elems);
+    l->elems = elems;
+    l->cap = cap;
+    l->head = 0;
+  }
+  if (end == REDISMODULE_LIST_HEAD) {
+    l->head = (l->head + l->cap - 1) % l->cap;
+    l->elems[l->head] = e;
+  } else {
+    l->elems[(l->head + l->len) % l->cap] = e;
+  }
+  l->len++;
+  return 1;
+}
+
+/* Pops an element and replies with it. */
+void ulist_pop_reply(RedisModuleCtx *ctx, UniqueList *l, int end) {
+  HashMapEntry *e;
+  if (end == REDISMODULE_LIST_HEAD) {
+    e = l->elems[l->head];
+    l->head = (l->head + 1) % l->cap;
+  } else {
+    e = l->elems[(l->head + l->len - 1) % l->cap];
+  }
+  l->len--;
+  RedisModule_ReplyWithStringBuffer(ctx, e->key, e->keylen);
+  HashMap_Delete(l->members, e->key, e->keylen, NULL);
+}
+
+void UniqueListFree(void *value) {
+  UniqueList *l = value;
+  HashMap_Free(l->members, NULL);
+  RedisModule_Free(l->elems);
+  RedisModule_Free(l);
+}
+
+size_t UniqueListMemUsage(const void *value) {
+  const UniqueList *l = value;
+  size_t size = sizeof(UniqueList) + l->cap * sizeof(HashMapEntry *) +
+                l->members->cap * sizeof(HashMapEntry *);
+  for (size_t i = 0; i < l->len; i++)
+    size += sizeof(HashMapEntry) + l->elems[(l->head + i) % l->cap]->keylen;
+  return size;
+}
+
+void UniqueListRdbSave(RedisModuleIO *rdb, void *value) {
+  UniqueList *l = value;
+  RedisModule_SaveUnsigned(rdb, l->len);
+  for (size_t i = 0; i < l->len; i++) {
+    HashMapEntry *e = l->elems[(l->head + i) % l->cap];
+    RedisModule_SaveStringBuffer(rdb, e->key, e->keylen);
+  }
+}
+
+void *UniqueListRdbLoad(RedisModuleIO *rdb, int encver) {
+  if (encver != UNIQUELIST_ENCODING_VERSION) return NULL;
+
+  UniqueList *l = ulist_new();
+  size_t len = RedisModule_LoadUnsigned(rdb);
+  while (len--) {
+    size_t elen;
+    char *ele = RedisModule_LoadStringBuffer(rdb, &elen);
+    ulist_push(l, ele, elen, REDISMODULE_LIST_TAIL);
+    RedisModule_Free(ele);
+  }
+  return l;
+}
+
+void UniqueListAofRewrite(RedisModuleIO *aof, RedisModuleString *key,
+                          void *value) {
+  UniqueList *l = value;
+  for (size_t i = 0; i < l->len; i++) {
+    HashMapEntry *e = l->elems[(l->head + i) % l->cap];
+    RedisModule_EmitAOF(aof, "RPUSHUNIQUE", "sb", key, e->key, e->keylen);
+  }
+}
+
+/*
+* LPUSHUNIQUE|RPUSHUNIQUE key ele [ele ...]
+* Pushes elements to the head or tail of a unique list, creating it if
+* needed. Elements that are already in the list are ignored, which is checked
+* in O(1) with the list's membership index.
+* Reply: Integer, the number of elements pushed.
+*/
+int PushUniqueGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                             int argc) {
+  if (argc < 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  /* Heads or tails? */
+  int lend = REDISMODULE_LIST_HEAD;
+  const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
+  if (!strcasecmp(cmd, "rpushunique")) lend = REDISMODULE_LIST_TAIL;
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, UniqueListType);
+  if (!key) return REDISMODULE_ERR;
+  UniqueList *l = RedisModule_ModuleTypeGetValue(key);
+
+  if (!l) {
+    l = ulist_new();
+    RedisModule_ModuleTypeSetValue(key, UniqueListType, l);
+  }
+  long long pushed = 0;
+  for (int i = 2; i < argc; i++) {
+    size_t len;
+    const char *ele = RedisModule_StringPtrLen(argv[i], &len);
+    pushed += ulist_push(l, ele, len, lend);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, pushed);
+  return REDISMODULE_OK;
+}
+
+/*
+* LPOPUNIQUE|RPOPUNIQUE key [count]
+* Pops elements from the head or tail of a unique list, removing them from
+* its membership index so they can be pushed again.
+* Reply: Bulk string, the element, or Null when the list is empty. With
+* `count`, an Array of up to `count` elements.
+*/
+int PopUniqueGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                            int argc) {
+  if (argc != 2 && argc != 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  /* Heads or tails? */
+  int lend = REDISMODULE_LIST_HEAD;
+  const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
+  if (!strcasecmp(cmd, "rpopunique")) lend = REDISMODULE_LIST_TAIL;
+
+  long long count = 1;
+  if ((argc == 3) &&
+      ((RedisModule_StringToLongLong(argv[2], &count) != REDISMODULE_OK) ||
+       (count < 0))) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid count");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, UniqueListType);
+  if (!key) return REDISMODULE_ERR;
+  UniqueList *l = RedisModule_ModuleTypeGetValue(key);
+
+  size_t len = (l ? l->len : 0);
+  if ((size_t)count > len) count = len;
+  if (argc == 2) {
+    if (!count)
+      RedisModule_ReplyWithNull(ctx);
+    else
+      ulist_pop_reply(ctx, l, lend);
+  } else {
+    RedisModule_ReplyWithArray(ctx, count);
+    for (long long i = 0; i < count; i++) ulist_pop_reply(ctx, l, lend);
+  }
+
+  if (l && !l->len) RedisModule_DeleteKey(key);
+  return REDISMODULE_OK;
+}
+
+/*
+* LLENUNIQUE key
+* Reply: Integer, the length of the unique list.
+*/
+int LLenUniqueCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key =
+      RMUtil_OpenModuleKey(ctx, argv[1], REDISMODULE_READ, UniqueListType);
+  if (!key) return REDISMODULE_ERR;
+  UniqueList *l = RedisModule_ModuleTypeGetValue(key);
+
+  RedisModule_ReplyWithLongLong(ctx, l ? l->len : 0);
+  return REDISMODULE_OK;
+}
+
+#define WINDOW_SEGMENT_SIZE 128
+#define WINDOW_ENCODING_VERSION 0
+
+/*
+* A segment of a time window, holding up to WINDOW_SEGMENT_SIZE elements in a
+* single buffer. Arrival times are kept compactly, as offsets from the arrival
+* of the segment's first element.
+*/
+typedef struct WindowSegment {
+  struct WindowSegment *prev, *next;
+  long long base;
+  uint32_t ages[WINDOW_SEGMENT_SIZE]; /* arrival offsets from base */
+  uint32_t ends[WINDOW_SEGMENT_SIZE]; /* end offsets of elements in buf */
+  int start;                          /* first element not trimmed */
+  int count;
+  size_t cap;
+  char *buf;
+} WindowSegment;
+
+/*
+* A list of the elements pushed in the last `maxage` milliseconds, up to
+* `cap` of them. Segments are ordered from the oldest to the newest, so
+* expired elements are trimmed from the head, a whole segment at a time when
+* its newest element has expired.
+*/
+typedef struct {
+  WindowSegment *head, *tail;
+  size_t len;
+  long long maxage, cap;
+  long long last; /* newest arrival time, so times never go back */
+  RedisModuleTimerID timer;
+  long long timerat; /* 0 when no timer is armed */
+  KeyTimer *timerkey;
+} Window;
+
+RedisModuleType *WindowType = NULL;
+
+/* The number of windows loaded from an RDB since loading last ended. */
+size_t windows_loaded = 0;
+
+Window *window_new(long long maxage, long long cap) {
+  Window *w = RedisModule_Calloc(1, sizeof(Window));
+  w->maxage = maxage;
+  w->cap = cap;
+  return w;
+}
+
+static inline long long window_at(const WindowSegment *s, int i) {
+  return s->base + s->ages[i];
+}
+
+/* Appends an element that arrived at `now` to the window. */
+void window_push(Window *w, long long now, const char *ele, size_t len) {
+  if (now < w->last) now = w->last;
+  w->last = now;
+
+  WindowSegment *s = w->tail;
+  size_t used = (s && s->count ? s->ends[s->count - 1] : 0);
+  if (!s || s->count == WINDOW_SEGMENT_SIZE ||
+      now - s->base > UINT32_MAX || used + len > UINT32_MAX) {
+    s = RedisModule_Calloc(1, sizeof(WindowSegment));
+    s->base = now;
+    s->prev = w->tail;
+    if (w->tail)
+      w->tail->next = s;
+    else
+      w->head = s;
+    w->tail = s;
+    used = 0;
+  }
+  if (used + len > s->cap) {
+    s->cap = (used + len) * 2;
+    s->buf = RedisModule_Realloc(s->buf, s->cap);
+  }
+  memcpy(s->buf + used, ele, len);
+  s->ages[s->count] = now - s->base;
+  s->ends[s->count] = used + len;
+  s->count++;
+  w->len++;
+}
+
+void window_drop_head(Window *w) {
+  WindowSegment *s = w->head;
+  w->len -= s->count - s->start;
+  w->head = s->next;
+  if (w->head)
+    w->head->prev = NULL;
+  else
+    w->tail = NULL;
+  RedisModule_Free(s->buf);
+  RedisModule_Free(s);
+}
+
+/* Trims the elements that have expired at `now` or are beyond the cap. */
+void window_trim(Window *w, long long now) {
+  long long cutoff = now - w->maxage;
+  while (w->head && window_at(w->head, w->head->count - 1) <= cutoff)
+    window_drop_head(w);
+  WindowSegment *s = w->head;
+  while (s && window_at(s, s->start) <= cutoff) {
+    s->start++;
+    w->len--;
+  }
+
+  while (w->len > (size_t)w->cap) {
+    size_t excess = w->len - w->cap;
+    s = w->head;
+    if ((size_t)(s->count - s->start) <= excess) {
+      window_drop_head(w);
+    } else {
+      s->start += excess;
+      w->len -= excess;
+    }
+  }
+}
+
+void WindowTimerHandler(RedisModuleCtx *ctx, void *data);
+
+/* Arms a timer for when the window's oldest segment expires, so that it is
+ * dropped even if the window isn't pushed to anymore. */
+void window_arm(RedisModuleCtx *ctx, Window *w, RedisModuleString *keyname) {
+  if (!RedisModule_CreateTimer || !w->head) return;
+
+  long long at = window_at(w->head, w->head->count - 1) + w->maxage;
+  if (keytimer_pending(ctx, w->timerkey, w->timerat, keyname) &&
+      w->timerat <= at)
+    return;
+
+  void *data;
+  if (w->timerat && RedisModule_StopTimer(ctx, w->timer, &data) ==
+                        REDISMODULE_OK)
+    RedisModule_Free(data);
+
+  long long now = RedisModule_Milliseconds();
+  w->timerkey = keytimer_new(ctx, keyname);
+  w->timer = RedisModule_CreateTimer(ctx, at > now ? at - now : 0,
+                                     WindowTimerHandler, w->timerkey);
+  w->timerat = at;
+}
+
+/* Trims a window once its oldest segment has expired, deleting it when
+ * empty. The window may have been deleted or replaced since the timer was
+ * armed. */
+void WindowTimerHandler(RedisModuleCtx *ctx, void *data) {
+  RedisModuleString *keyname = keytimer_keyname(ctx, data);
+
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+  if (RedisModule_ModuleTypeGetType(key) == WindowType) {
+    Window *w = RedisModule_ModuleTypeGetValue(key);
+    w->timerat = 0;
+    window_trim(w, RedisModule_Milliseconds());
+    if (!w->len)
+      RedisModule_DeleteKey(key);
+    else
+      window_arm(ctx, w, keyname);
+  }
+  RedisModule_CloseKey(key);
+  RedisModule_FreeString(ctx, keyname);
+}
+
+/* Keyspace notifications handler that re-arms the timers of delayed queues
+ * and windows under their new names after a RENAME or MOVE, as the pending
+ * ones fire on the old names. */
+int KeyTimerNotify(RedisModuleCtx *ctx, int type, const char *event,
+                   RedisModuleString *keyname) {
+  if (strcmp(event, "rename_to") && strcmp(event, "move_to"))
+    return REDISMODULE_OK;
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+  RedisModuleType *mt = RedisModule_ModuleTypeGetType(key);
+  if (mt && mt == DelayQueueType)
+    dq_arm(ctx, RedisModule_ModuleTypeGetValue(key), keyname);
+  else if (mt && mt == WindowType)
+    window_arm(ctx, RedisModule_ModuleTypeGetValue(key), keyname);
+  RedisModule_CloseKey(key);
+  return REDISMODULE_OK;
+}
+
+/*
+* Arms the timers of the windows loaded from an RDB once loading ends, as no
+* command does it for windows that aren't pushed to anymore. Loaded windows
+* don't know their keys, so every database is scanned for keys of their type.
+*/
+void WindowLoadingEvent(RedisModuleCtx *ctx, RedisModuleEvent eid,
+                        uint64_t subevent, void *data) {
+  if (subevent == REDISMODULE_SUBEVENT_LOADING_FAILED) windows_loaded = 0;
+  if (subevent != REDISMODULE_SUBEVENT_LOADING_ENDED || !windows_loaded)
+    return;
+  windows_loaded = 0;
+
+  int db = RedisModule_GetSelectedDb(ctx);
+  for (int i = 0; RedisModule_SelectDb(ctx, i) == REDISMODULE_OK; i++) {
+    RedisModuleString *scursor =
+        RedisModule_CreateStringFromLongLong(ctx, 0);
+    long long lcursor = 0;
+    do {
+      RedisModuleCallReply *rep =
+          RedisModule_Call(ctx, "SCAN", "scccc", scursor, "TYPE", "rxwindowl",
+                           "COUNT", "1000");
+      RedisModule_FreeString(ctx, scursor);
+      scursor = NULL;
+      if (!rep || RedisModule_CallReplyType(rep) != REDISMODULE_REPLY_ARRAY ||
+          RedisModule_CallReplyLength(rep) != 2) {
+        if (rep) RedisModule_FreeCallReply(rep);
+        break;
+      }
+      scursor = RedisModule_CreateStringFromCallReply(
+          RedisModule_CallReplyArrayElement(rep, 0));
+      RedisModule_StringToLongLong(scursor, &lcursor);
+
+      RedisModuleCallReply *rkeys = RedisModule_CallReplyArrayElement(rep, 1);
+      size_t nkeys = RedisModule_CallReplyLength(rkeys);
+      for (size_t j = 0; j < nkeys; j++) {
+        RedisModuleString *keyname = RedisModule_CreateStringFromCallReply(
+            RedisModule_CallReplyArrayElement(rkeys, j));
+        RedisModuleKey *key =
+            RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+        if (RedisModule_ModuleTypeGetType(key) == WindowType)
+          window_arm(ctx, RedisModule_ModuleTypeGetValue(key), keyname);
+        RedisModule_CloseKey(key);
+        RedisModule_FreeString(ctx, keyname);
+      }
+      RedisModule_FreeCallReply(rep);
+    } while (lcursor);
+    if (scursor) RedisModule_FreeString(ctx, scursor);
+  }
+  RedisModule_SelectDb(ctx, db);
+}
+
+void WindowFree(void *value) {
+  Window *w = value;
+  while (w->head) window_drop_head(w);
+  RedisModule_Free(w);
+}
+
+size_t WindowMemUsage(const void *value) {
+  const Window *w = value;
+  size_t size = sizeof(Window);
+  for (WindowSegment *s = w->head; s; s = s->next)
+    size += sizeof(WindowSegment) + s->cap;
+  return size;
+}
+
+void WindowRdbSave(RedisModuleIO *rdb, void *value) {
+  Window *w = value;
+  RedisModule_SaveSigned(rdb, w->maxage);
+  RedisModule_SaveSigned(rdb, w->cap);
+  RedisModule_SaveUnsigned(rdb, w->len);
+  for (WindowSegment *s = w->head; s; s = s->next) {
+    for (int i = s->start; i < s->count; i++) {
+      size_t off = (i ? s->ends[i - 1] : 0);
+      RedisModule_SaveSigned(rdb, window_at(s, i));
+      RedisModule_SaveStringBuffer(rdb, s->buf + off, s->ends[i] - off);
+    }
+  }
+}
+
+void *WindowRdbLoad(RedisModuleIO *rdb, int encver) {
+  if (encver != WINDOW_ENCODING_VERSION) return NULL;
+
+  long long maxage = RedisModule_LoadSigned(rdb);
+  long long cap = RedisModule_LoadSigned(rdb);
+  Window *w = window_new(maxage, cap);
+  size_t len = RedisModule_LoadUnsigned(rdb);
+  while (len--) {
+    long long at = RedisModule_LoadSigned(rdb);
+    size_t elen;
+    char *ele = RedisModule_LoadStringBuffer(rdb, &elen);
+    window_push(w, at, ele, elen);
+    RedisModule_Free(ele);
+  }
+  windows_loaded++;
+  return w;
+}
+
+/* Arrival times can't be given to LPUSHWINDOW, so elements restored from the
+ * AOF arrive anew when it is loaded. */
+void WindowAofRewrite(RedisModuleIO *aof, RedisModuleString *key,
+                      void *value) {
+  Window *w = value;
+  for (WindowSegment *s = w->head; s; s = s->next) {
+    for (int i = s->start; i < s->count; i++) {
+      size_t off = (i ? s->ends[i - 1] : 0);
+      RedisModule_EmitAOF(aof, "LPUSHWINDOW", "sllb", key, w->maxage, w->cap,
+                          s->buf + off, (size_t)(s->ends[i] - off));
+    }
+  }
+}
+
+/*
+* LPUSHWINDOW key max-age cap ele [ele ...]
+* Pushes elements to the head of a time window list, creating it if needed.
+* Elements older than `max-age` milliseconds are trimmed from its tail, as
+* are elements beyond `cap`. Like LPUSHCAPPED, elements that would be trimmed
+* right away aren't pushed at all.
+* Reply: Integer, the window's new length.
+*/
+int LPushWindowCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc) {
+  if (argc < 5) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  long long maxage, cap;
+  if ((RedisModule_StringToLongLong(argv[2], &maxage) != REDISMODULE_OK) ||
+      (maxage < 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid max-age");
+    return REDISMODULE_ERR;
+  }
+  if ((RedisModule_StringToLongLong(argv[3], &cap) != REDISMODULE_OK) ||
+      (cap < 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid cap");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, WindowType);
+  if (!key) return REDISMODULE_ERR;
+
+  Window *w = RedisModule_ModuleTypeGetValue(key);
+  if (!w) {
+    w = window_new(maxage, cap);
+    RedisModule_ModuleTypeSetValue(key, WindowType, w);
+  } else {
+    w->maxage = maxage;
+    w->cap = cap;
+  }
+
+  /* Only the last cap elements can survive the trim, so push just these. */
+  long long now = RedisModule_Milliseconds();
+  int first = (argc - 4 > cap ? argc - cap : 4);
+  for (int i = first; i < argc; i++) {
+    size_t len;
+    const char *ele = RedisModule_StringPtrLen(argv[i], &len);
+    window_push(w, now, ele, len);
+  }
+  window_trim(w, now);
+  window_arm(ctx, w, argv[1]);
+
+  RedisModule_ReplyWithLongLong(ctx, w->len);
+  return REDISMODULE_OK;
+}
+
+/*
+* LWINDOW key
+* Reply: Array of the window's elements that haven't expired, from the newest
+* to the oldest.
+*/
+int LWindowCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key =
+      RMUtil_OpenModuleKey(ctx, argv[1], REDISMODULE_READ, WindowType);
+  if (!key) return REDISMODULE_ERR;
+  Window *w = RedisModule_ModuleTypeGetValue(key);
+  if (!w) {
+    RedisModule_ReplyWithArray(ctx, 0);
+    return REDISMODULE_OK;
+  }
+
+  /* Expired elements are left for the next push or the timer to trim. */
+  long long cutoff = RedisModule_Milliseconds() - w->maxage;
+  long long n = 0;
+  RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+  for (WindowSegment *s = w->tail; s; s = s->prev) {
+    int i;
+    for (i = s->count - 1; i >= s->start && window_at(s, i) > cutoff; i--) {
+      size_t off = (i ? s->ends[i - 1] : 0);
+      RedisModule_ReplyWithStringBuffer(ctx, s->buf + off, s->ends[i] - off);
+      n++;
+    }
+    if (i >= s->start) break;
+  }
+  RedisModule_ReplySetArrayLength(ctx, n);
+
+  return REDISMODULE_OK;
+}
+
+int testLSplice(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "lsplice", "ccc", "src", "dst", "3");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "RPUSH", "cccccc", "src", "1", "2", "3", "a", "b");
+  r = RedisModule_Call(ctx, "lsplice", "ccc", "src", "dst", "2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "dst", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "b");
+  r = RedisModule_Call(ctx, "lsplice", "ccc", "src", "dst", "4");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "dst", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 5);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "2");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "3");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 3), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 4), "b");
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testLXSplice(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "RPUSH", "cccccc", "src", "1", "2", "3", "4", "5");
+  r = RedisModule_Call(ctx, "RPUSH", "cc", "dst", "x");
+  r = RedisModule_Call(ctx, "lxsplice", "ccc", "src", "dst", "2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "lxsplice", "ccccc", "src", "dst", "-2", "ATTACH",
+                       "-1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "lxsplice", "ccccccc", "dst", "src", "3", "ATTACH",
+                       "-1", "ORDER", "DESC");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "dst", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "4");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "5");
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "src", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 4);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "3");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "x");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "2");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 3), "1");
+  r = RedisModule_Call(ctx, "lxsplice", "ccccc", "src", "src", "1", "ORDER",
+                       "NOEFFORT");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 4);
+  r = RedisModule_Call(ctx, "LINDEX", "cc", "src", "0");
+  RMUtil_AssertReplyEquals(r, "3");
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testLPopRPush(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "lpoprpush", "cc", "src", "dst");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "RPUSH", "cccccc", "src", "1", "2", "3", "a", "b");
+  r = RedisModule_Call(ctx, "lpoprpush", "cc", "src", "dst");
+  RMUtil_AssertReplyEquals(r, "1");
+    r = RedisModule_Call(ctx, "lpoprpush", "cc", "src", "dst");
+  RMUtil_AssertReplyEquals(r, "2");
+  r = RedisModule_Call(ctx, "lpoprpush", "cc", "src", "dst");
+  RMUtil_AssertReplyEquals(r, "3");
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "src", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "b");
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "dst", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "2");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "3");
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testLMPop(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "lmpop", "cc", "list", "42");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 0);
+  r = RedisModule_Call(ctx, "RPUSH", "cccccc", "list", "1", "2", "3", "a", "b");
+  r = RedisModule_Call(ctx, "lmpop", "cc", "list", "3");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "2");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "3");
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "list", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "b");
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testLMPopMulti(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "RPUSH", "ccc", "hi", "1", "2");
+  r = RedisModule_Call(ctx, "RPUSH", "cccc", "lo", "a", "b", "c");
+  r = RedisModule_Call(ctx, "rmpop", "cc", "lo", "2");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "b");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "c");
+  r = RedisModule_Call(ctx, "RPUSH", "ccc", "lo", "b", "c");
+  r = RedisModule_Call(ctx, "lmpopmulti", "cccc", "4", "none", "hi", "lo");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "1 1"),
+                           "hi");
+  RMUtil_Assert(RedisModule_CallReplyLength(
+                    RedisModule_CallReplyArrayElementByPath(r, "1 2")) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "2 1"),
+                           "lo");
+  RMUtil_AssertReplyEquals(
+      RedisModule_CallReplyArrayElementByPath(r, "2 2 2"), "b");
+  r = RedisModule_Call(ctx, "LLEN", "c", "lo");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "SET", "cc", "str", "foo");
+  r = RedisModule_Call(ctx, "lmpopmulti", "ccc", "1", "lo", "str");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "LLEN", "c", "lo");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testBLMPop(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "RPUSH", "cccc", "list", "1", "2", "3");
+  r = RedisModule_Call(ctx, "blmpop", "cccc", "0", "2", "none", "list");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "list");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "2 2"),
+                           "2");
+  r = RedisModule_Call(ctx, "RPUSH", "cc", "list", "4");
+  r = RedisModule_Call(ctx, "brmpop", "ccc", "0.1", "5", "list");
+  RMUtil_Assert(RedisModule_CallReplyLength(
+                    RedisModule_CallReplyArrayElement(r, 1)) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "2 1"),
+                           "3");
+  r = RedisModule_Call(ctx, "SET", "cc", "str", "foo");
+  r = RedisModule_Call(ctx, "blmpop", "ccc", "0", "1", "str");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testLPushCapped(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "lpushcapped", "ccc", "list", "3", "1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "lpushcapped", "ccc", "list", "3", "2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);  
+  r = RedisModule_Call(ctx, "lpushcapped", "ccc", "list", "3", "3");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "lpushcapped", "ccc", "list", "3", "4");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "list", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "4");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "3");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "2");
+  r = RedisModule_Call(ctx, "lpushcapped", "ccccc", "list", "3", "5", "6", "7");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "list", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "7");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "6");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "5");
+  r = RedisModule_Call(ctx, "rpushcapped", "cccccc", "list", "2", "a", "b", "c",
+                       "d");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "LRANGE", "ccc", "list", "0", "-1");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "c");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "d");
+  
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testRing(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "ring.len", "c", "ring");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "ring.push", "ccccc", "ring", "3", "1", "2", "3");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "ring.push", "cccc", "ring", "3", "4", "5");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "ring.range", "ccc", "ring", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "3");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "5");
+  r = RedisModule_Call(ctx, "ring.push", "ccc", "ring", "2", "6");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "ring.range", "ccc", "ring", "-1", "5");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "6");
+  r = RedisModule_Call(ctx, "lpushcapped", "ccccc", "list", "5", "a", "b",
+                       "c");
+  r = RedisModule_Call(ctx, "ring.fromlist", "ccc", "list", "2", "HEAD");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "ring.range", "ccc", "list", "0", "-1");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "b");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "c");
+  r = RedisModule_Call(ctx, "LLEN", "c", "list");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testQueue(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "q.pop", "ccc", "queue", "1", "1000");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 0);
+  r = RedisModule_Call(ctx, "q.push", "cccc", "queue", "a", "b", "c");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "q.pop", "ccc", "queue", "2", "100000");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "1 2"),
+                           "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "2 2"),
+                           "b");
+  RedisModuleString *id = RedisModule_CreateStringFromCallReply(
+      RedisModule_CallReplyArrayElementByPath(r, "1 1"));
+  r = RedisModule_Call(ctx, "q.ack", "csc", "queue", id, "0");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "q.ack", "cs", "queue", id);
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "q.len", "c", "queue");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "q.pop", "ccc", "queue", "5", "1000");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElementByPath(r, "1 2"),
+                           "c");
+  r = RedisModule_Call(ctx, "LPUSH", "cc", "list", "a");
+  r = RedisModule_Call(ctx, "q.push", "cc", "list", "a");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testDelayQueue(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "dq.add", "ccccccc", "dq", "2", "b", "1", "a",
+                       "99999999999999", "z");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "dq.add", "ccc", "dq", "1", "a2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 4);
+  r = RedisModule_Call(ctx, "dq.popready", "cc", "dq", "2");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "a2");
+  r = RedisModule_Call(ctx, "dq.popready", "cc", "dq", "10");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "b");
+  r = RedisModule_Call(ctx, "dq.popready", "cc", "dq", "10");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 0);
+  r = RedisModule_Call(ctx, "EXISTS", "c", "dq");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testPushUnique(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "rpushunique", "ccccc", "list", "a", "b", "a",
+                       "c");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "lpushunique", "ccc", "list", "c", "z");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "llenunique", "c", "list");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 4);
+  r = RedisModule_Call(ctx, "lpopunique", "c", "list");
+  RMUtil_AssertReplyEquals(r, "z");
+  r = RedisModule_Call(ctx, "rpopunique", "cc", "list", "2");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "c");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "b");
+  r = RedisModule_Call(ctx, "rpushunique", "ccc", "list", "a", "c");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "lpopunique", "cc", "list", "5");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  r = RedisModule_Call(ctx, "lpopunique", "c", "list");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "EXISTS", "c", "list");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testWindow(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "lpushwindow", "ccccc", "window", "60000", "3",
+                       "a", "b");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "lpushwindow", "cccccc", "window", "60000", "3",
+                       "c", "d", "e");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "lwindow", "c", "window");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "e");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "c");
+  r = RedisModule_Call(ctx, "lpushwindow", "cccc", "window", "60000", "0", "f");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "lwindow", "c", "nowindow");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 0);
+  r = RedisModule_Call(ctx, "SET", "cc", "foo", "bar");
+  r = RedisModule_Call(ctx, "lwindow", "c", "foo");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
 }
 
 int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
@@ -460,9 +2552,17 @@ int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   }
 
   RMUtil_Test(testLSplice);
+  RMUtil_Test(testLXSplice);
   RMUtil_Test(testLPopRPush);
   RMUtil_Test(testLMPop);
+  RMUtil_Test(testLMPopMulti);
+  if (RedisModule_BlockClientOnKeys) RMUtil_Test(testBLMPop);
   RMUtil_Test(testLPushCapped);
+  if (RingType) RMUtil_Test(testRing);
+  if (QueueType) RMUtil_Test(testQueue);
+  if (DelayQueueType) RMUtil_Test(testDelayQueue);
+  if (UniqueListType) RMUtil_Test(testPushUnique);
+  if (WindowType) RMUtil_Test(testWindow);
 
   RedisModule_ReplyWithSimpleString(ctx, "PASS");
   return REDISMODULE_OK;
@@ -491,6 +2591,21 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                 1, 1, 1) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
 
+  if (RedisModule_CreateCommand(ctx, "lmpopmulti", LMPopMultiCommand, "write",
+                                2, -1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+
+  /* Blocking on keys requires a server that supports it. */
+  if (RedisModule_BlockClientOnKeys) {
+    if (RedisModule_CreateCommand(ctx, "blmpop", BMPopGenericCommand,
+                                  "write", 3, -1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "brmpop", BMPopGenericCommand,
+                                  "write", 3, -1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+  }
+
   if (RedisModule_CreateCommand(ctx, "lpushcapped", PushCappedGenericCommand,
                                 "write fast deny-oom", 1, 1,
                                 1) == REDISMODULE_ERR)
@@ -499,6 +2614,153 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                 "write fast deny-oom", 1, 1,
                                 1) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
+
+  /* The ring buffer and queue types require a server with module types
+   * support. */
+  if (RedisModule_CreateDataType) {
+    RedisModuleTypeMethods tm = {.version = REDISMODULE_TYPE_METHOD_VERSION,
+                                 .rdb_load = RingRdbLoad,
+                                 .rdb_save = RingRdbSave,
+                                 .aof_rewrite = RingAofRewrite,
+                                 .mem_usage = RingMemUsage,
+                                 .free = RingFree};
+    RingType = RedisModule_CreateDataType(ctx, "rxringbuf",
+                                          RING_ENCODING_VERSION, &tm);
+    if (RingType == NULL) return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "ring.push", RingPushCommand,
+                                  "write deny-oom", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "ring.range", RingRangeCommand,
+                                  "readonly", 1, 1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "ring.len", RingLenCommand,
+                                  "readonly fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "ring.fromlist", RingFromListCommand,
+                                  "write deny-oom", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    tm.rdb_load = QueueRdbLoad;
+    tm.rdb_save = QueueRdbSave;
+    tm.aof_rewrite = QueueAofRewrite;
+    tm.mem_usage = QueueMemUsage;
+    tm.free = QueueFree;
+    QueueType = RedisModule_CreateDataType(ctx, "rxrlqueue",
+                                           QUEUE_ENCODING_VERSION, &tm);
+    if (QueueType == NULL) return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "q.push", QPushCommand,
+                                  "write deny-oom fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "q.pop", QPopCommand, "write", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "q.ack", QAckCommand, "write fast", 1,
+                                  1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "q.len", QLenCommand, "readonly fast",
+                                  1, 1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    tm.rdb_load = DelayQueueRdbLoad;
+    tm.rdb_save = DelayQueueRdbSave;
+    tm.aof_rewrite = DelayQueueAofRewrite;
+    tm.mem_usage = DelayQueueMemUsage;
+    tm.free = DelayQueueFree;
+    DelayQueueType = RedisModule_CreateDataType(
+        ctx, "rxdelayqu", DELAYQUEUE_ENCODING_VERSION, &tm);
+    if (DelayQueueType == NULL) return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "dq.add", DQAddCommand,
+                                  "write deny-oom fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "dq.popready", DQPopReadyCommand,
+                                  "write", 1, 1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    /* Blocked clients are woken by timers and signaled keys. */
+    if (RedisModule_BlockClientOnKeys && RedisModule_CreateTimer &&
+        RedisModule_SignalKeyAsReady) {
+      if (RedisModule_CreateCommand(ctx, "dq.bpopready", DQBPopReadyCommand,
+                                    "write", 1, 1, 1) == REDISMODULE_ERR)
+        return REDISMODULE_ERR;
+    }
+
+    tm.rdb_load = UniqueListRdbLoad;
+    tm.rdb_save = UniqueListRdbSave;
+    tm.aof_rewrite = UniqueListAofRewrite;
+    tm.mem_usage = UniqueListMemUsage;
+    tm.free = UniqueListFree;
+    UniqueListType = RedisModule_CreateDataType(
+        ctx, "rxuniqlst", UNIQUELIST_ENCODING_VERSION, &tm);
+    if (UniqueListType == NULL) return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "lpushunique", PushUniqueGenericCommand,
+                                  "write deny-oom fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "rpushunique", PushUniqueGenericCommand,
+                                  "write deny-oom fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "lpopunique", PopUniqueGenericCommand,
+                                  "write fast", 1, 1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "rpopunique", PopUniqueGenericCommand,
+                                  "write fast", 1, 1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "llenunique", LLenUniqueCommand,
+                                  "readonly fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    tm.rdb_load = WindowRdbLoad;
+    tm.rdb_save = WindowRdbSave;
+    tm.aof_rewrite = WindowAofRewrite;
+    tm.mem_usage = WindowMemUsage;
+    tm.free = WindowFree;
+    WindowType = RedisModule_CreateDataType(ctx, "rxwindowl",
+                                            WINDOW_ENCODING_VERSION, &tm);
+    if (WindowType == NULL) return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "lpushwindow", LPushWindowCommand,
+                                  "write deny-oom", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "lwindow", LWindowCommand, "readonly",
+                                  1, 1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+
+    if (RedisModule_SubscribeToKeyspaceEvents &&
+        RedisModule_SubscribeToKeyspaceEvents(ctx, REDISMODULE_NOTIFY_GENERIC,
+                                              KeyTimerNotify) ==
+            REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_SubscribeToServerEvent &&
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_Loading,
+                                           WindowLoadingEvent) ==
+            REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+  }
+
   if (RedisModule_CreateCommand(ctx, "rxlists.test", TestModule, "write", 0, 0,
                                 0) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
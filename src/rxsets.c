@@ -15,12 +15,396 @@
 * You should have received a copy of the GNU Affero General Public License
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../redismodule.h"
 #include "../rmutil/util.h"
 #include "../rmutil/test_util.h"
+#include "../rmutil/hashmap.h"
+#include "../rmutil/roaring.h"
 
 #define RM_MODULE_NAME "rxsets"
 
+/* Bits per block of a set's Bloom filter: a member's bits all fall in one
+ * cache line, so checking it costs a single memory access. */
+#define SBLOOM_BLOCK_BITS 512
+#define SBLOOM_BLOCK_WORDS (SBLOOM_BLOCK_BITS / 64)
+#define SBLOOM_MIN_CAPACITY 1024
+
+/*
+* A blocked Bloom filter of a set's members, for rejecting the members that
+* aren't in it without looking up the set. It is only added to by
+* SBLOOM.SADD, so other additions make it stale, as do too many removals or
+* additions beyond its capacity. Lookups bypass a stale filter until
+* SBLOOM.ENABLE or SBLOOM.SADD rebuilds it from the set, so they never scan
+* the set.
+*/
+typedef struct {
+  double fprate;
+  uint64_t *bits;
+  size_t nblocks;
+  int hashes;
+  size_t capacity; /* members the filter is sized for */
+  size_t items;    /* members added since the last build */
+  int stale;
+  long long probes, negatives, falsepositives, rebuilds;
+} SBloom;
+
+/* The largest MinHash signature. */
+#define SSIG_MAX_K 4096
+
+/*
+* A MinHash signature of a set: the smallest value of each of k hash functions
+* over its members, from which the Jaccard similarity of two sets is
+* estimated. Like Bloom filters, signatures are only added to by SBLOOM.SADD,
+* but any removal makes them stale too. Stale signatures aren't used until
+* SSIG.BUILD rebuilds them.
+*/
+typedef struct {
+  int k;
+  uint64_t *mins;
+  int stale;
+} SSig;
+
+/*
+* The insertion order of the members SADDCAPPED adds to a set, for evicting
+* the oldest ones. Records are a uint32_t length followed by the member, in a
+* buffer consumed from its head. Members removed by other commands are left
+* in it, and skipped when evicting or compacting. A member added again after
+* being removed has more than one record, and only its newest one counts.
+*/
+typedef struct {
+  char *buf;
+  size_t head, used, cap;
+  size_t count;
+  HashMap *records; /* member -> number of its records */
+} SFifo;
+
+/* The structures maintained along a set, kept in memory only and looked up
+ * by the set's database and name. */
+typedef struct {
+  SBloom *bloom;
+  SSig *sig;
+  SFifo *fifo;
+} SetCompanion;
+
+HashMap *set_companions = NULL;
+
+/* Set while SBLOOM.SADD adds members, so their notifications don't make
+ * the set's companions stale. */
+int companion_adding = 0;
+
+/* Companions are keyed by their set's database followed by its name. */
+char *companion_regkey(int db, RedisModuleString *keyname, size_t *len) {
+  size_t nlen;
+  const char *name = RedisModule_StringPtrLen(keyname, &nlen);
+  char *regkey = RedisModule_Alloc(sizeof(int) + nlen);
+  memcpy(regkey, &db, sizeof(int));
+  memcpy(regkey + sizeof(int), name, nlen);
+  *len = sizeof(int) + nlen;
+  return regkey;
+}
+
+/* Finds the companion of a set, creating it if create is set. */
+SetCompanion *companion_get(int db, RedisModuleString *keyname, int create) {
+  size_t len;
+  char *regkey = companion_regkey(db, keyname, &len);
+  SetCompanion *c;
+  if (create) {
+    HashMapEntry *e = HashMap_Insert(set_companions, regkey, len, NULL);
+    if (!e->value) e->value = RedisModule_Calloc(1, sizeof(SetCompanion));
+    c = e->value;
+  } else {
+    c = HashMap_Get(set_companions, regkey, len);
+  }
+  RedisModule_Free(regkey);
+  return c;
+}
+
+void sbloom_free(SBloom *bf) {
+  if (!bf) return;
+  RedisModule_Free(bf->bits);
+  RedisModule_Free(bf);
+}
+
+void ssig_free(SSig *sig) {
+  if (!sig) return;
+  RedisModule_Free(sig->mins);
+  RedisModule_Free(sig);
+}
+
+void sfifo_free(SFifo *f) {
+  if (!f) return;
+  RedisModule_Free(f->buf);
+  if (f->records) HashMap_Free(f->records, NULL);
+  RedisModule_Free(f);
+}
+
+void sfifo_push(SFifo *f, const char *ele, size_t len) {
+  uint32_t rlen = len;
+  if (f->used + sizeof(rlen) + len > f->cap) {
+    /* Reclaim the consumed head first, growing only if that's not enough. */
+    if (f->head) memmove(f->buf, f->buf + f->head, f->used - f->head);
+    f->used -= f->head;
+    f->head = 0;
+    if (f->used + sizeof(rlen) + len > f->cap / 2) {
+      f->cap = (f->used + sizeof(rlen) + len) * 2;
+      f->buf = RedisModule_Realloc(f->buf, f->cap);
+    }
+  }
+  memcpy(f->buf + f->used, &rlen, sizeof(rlen));
+  memcpy(f->buf + f->used + sizeof(rlen), ele, len);
+  f->used += sizeof(rlen) + len;
+  f->count++;
+
+  if (!f->records) f->records = NewHashMap(16);
+  HashMapEntry *e = HashMap_Insert(f->records, ele, len, NULL);
+  e->value = (void *)((size_t)e->value + 1);
+}
+
+/* Pops the oldest record, whose member stays valid until the next push.
+ * newest is set to whether the member has no newer records. */
+const char *sfifo_pop(SFifo *f, size_t *len, int *newest) {
+  if (!f->count) return NULL;
+  uint32_t rlen;
+  memcpy(&rlen, f->buf + f->head, sizeof(rlen));
+  const char *ele = f->buf + f->head + sizeof(rlen);
+  f->head += sizeof(rlen) + rlen;
+  f->count--;
+  *len = rlen;
+
+  HashMapEntry *e = HashMap_Find(f->records, ele, rlen);
+  e->value = (void *)((size_t)e->value - 1);
+  *newest = !e->value;
+  if (*newest) HashMap_Delete(f->records, ele, rlen, NULL);
+  return ele;
+}
+
+void companion_free(void *value) {
+  SetCompanion *c = value;
+  sbloom_free(c->bloom);
+  ssig_free(c->sig);
+  sfifo_free(c->fifo);
+  RedisModule_Free(c);
+}
+
+void companion_delete(int db, RedisModuleString *keyname) {
+  size_t len;
+  char *regkey = companion_regkey(db, keyname, &len);
+  void *c;
+  if (HashMap_Delete(set_companions, regkey, len, &c)) companion_free(c);
+  RedisModule_Free(regkey);
+}
+
+/* Deletes the companion of a set once it has nothing left. */
+void companion_release(int db, RedisModuleString *keyname) {
+  SetCompanion *c = companion_get(db, keyname, 0);
+  if (c && !c->bloom && !c->sig && !c->fifo) companion_delete(db, keyname);
+}
+
+typedef void (*SetsScanFunc)(void *privdata, const char *ele, size_t len);
+
+/* Calls fn for each member of a set, scanning it with SSCAN. */
+void sets_scan(RedisModuleCtx *ctx, RedisModuleString *keyname,
+               SetsScanFunc fn, void *privdata) {
+  RedisModuleString *scursor = RedisModule_CreateStringFromLongLong(ctx, 0);
+  long long lcursor;
+  do {
+    RedisModuleCallReply *rep =
+        RedisModule_Call(ctx, "SSCAN", "sscc", keyname, scursor, "COUNT",
+                         "1000");
+    RedisModule_FreeString(ctx, scursor);
+    scursor = RedisModule_CreateStringFromCallReply(
+        RedisModule_CallReplyArrayElement(rep, 0));
+    RedisModule_StringToLongLong(scursor, &lcursor);
+
+    RedisModuleCallReply *rmembers = RedisModule_CallReplyArrayElement(rep, 1);
+    size_t nmembers = RedisModule_CallReplyLength(rmembers);
+    for (size_t i = 0; i < nmembers; i++) {
+      size_t len;
+      const char *ele = RedisModule_CallReplyStringPtr(
+          RedisModule_CallReplyArrayElement(rmembers, i), &len);
+      fn(privdata, ele, len);
+    }
+    RedisModule_FreeCallReply(rep);
+  } while (lcursor);
+  RedisModule_FreeString(ctx, scursor);
+}
+
+/* Returns the block of a member's bits, and its hash for picking them. */
+static inline uint64_t *sbloom_block(SBloom *bf, const char *ele, size_t len,
+                                     uint64_t *h) {
+  *h = HashMap_Hash(ele, len);
+  return bf->bits + (*h % bf->nblocks) * SBLOOM_BLOCK_WORDS;
+}
+
+void sbloom_add(SBloom *bf, const char *ele, size_t len) {
+  uint64_t h;
+  uint64_t *block = sbloom_block(bf, ele, len, &h);
+  uint32_t a = h >> 32, b = (uint32_t)h | 1;
+  for (int i = 0; i < bf->hashes; i++) {
+    uint32_t bit = (a + i * b) % SBLOOM_BLOCK_BITS;
+    block[bit / 64] |= 1ULL << (bit % 64);
+  }
+}
+
+/* sbloom_add() as a SetsScanFunc. */
+void sbloom_add_scanned(void *privdata, const char *ele, size_t len) {
+  sbloom_add(privdata, ele, len);
+}
+
+/* Returns 0 if the member is certainly not in the set, 1 if it may be. */
+int sbloom_maybe(SBloom *bf, RedisModuleString *member) {
+  size_t len;
+  const char *ele = RedisModule_StringPtrLen(member, &len);
+  uint64_t h;
+  uint64_t *block = sbloom_block(bf, ele, len, &h);
+  uint32_t a = h >> 32, b = (uint32_t)h | 1;
+  bf->probes++;
+  for (int i = 0; i < bf->hashes; i++) {
+    uint32_t bit = (a + i * b) % SBLOOM_BLOCK_BITS;
+    if (!(block[bit / 64] & (1ULL << (bit % 64)))) {
+      bf->negatives++;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* (Re)builds a filter from its set's members, sized for twice as many. */
+void sbloom_build(RedisModuleCtx *ctx, SBloom *bf, RedisModuleKey *key,
+                  RedisModuleString *keyname) {
+  size_t card = RedisModule_ValueLength(key);
+  bf->capacity = card * 2;
+  if (bf->capacity < SBLOOM_MIN_CAPACITY) bf->capacity = SBLOOM_MIN_CAPACITY;
+  double bits =
+      ceil(-(double)bf->capacity * log(bf->fprate) / (M_LN2 * M_LN2));
+  bf->nblocks = (size_t)ceil(bits / SBLOOM_BLOCK_BITS);
+  bf->hashes = (int)round(-log2(bf->fprate));
+  if (bf->hashes < 1) bf->hashes = 1;
+  if (bf->hashes > 16) bf->hashes = 16;
+  RedisModule_Free(bf->bits);
+  bf->bits =
+      RedisModule_Calloc(bf->nblocks * SBLOOM_BLOCK_WORDS, sizeof(uint64_t));
+  bf->items = card;
+  bf->stale = 0;
+
+  if (card) sets_scan(ctx, keyname, sbloom_add_scanned, bf);
+}
+
+/* Returns the filter of a set, or NULL if the set has none or it is stale. */
+SBloom *sbloom_get(RedisModuleCtx *ctx, RedisModuleString *keyname) {
+  if (!set_companions || !HashMap_Size(set_companions)) return NULL;
+  SetCompanion *c =
+      companion_get(RedisModule_GetSelectedDb(ctx), keyname, 0);
+  if (!c || !c->bloom) return NULL;
+
+  return c->bloom->stale ? NULL : c->bloom;
+}
+
+/* Keeps the companions of sets current. Deleted sets lose them, and changes
+ * that SBLOOM.SADD didn't make mark them as stale. Removals only make
+ * filters stale once they exceed a quarter of the members. */
+int SetCompanionNotify(RedisModuleCtx *ctx, int type, const char *event,
+                       RedisModuleString *keyname) {
+  if (!HashMap_Size(set_companions)) return REDISMODULE_OK;
+
+  int db = RedisModule_GetSelectedDb(ctx);
+  SetCompanion *c = companion_get(db, keyname, 0);
+  if (!c) return REDISMODULE_OK;
+
+  if (!strcmp(event, "del") || !strcmp(event, "expired") ||
+      !strcmp(event, "evicted") || !strcmp(event, "rename_from") ||
+      !strcmp(event, "move_from")) {
+    companion_delete(db, keyname);
+    return REDISMODULE_OK;
+  }
+  if (!strcmp(event, "expire") || !strcmp(event, "persist"))
+    return REDISMODULE_OK;
+
+  int added = (!strcmp(event, "sadd") && companion_adding);
+  SBloom *bf = c->bloom;
+  if (bf && (!strcmp(event, "srem") || !strcmp(event, "spop"))) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+    size_t card = RedisModule_ValueLength(key);
+    RedisModule_CloseKey(key);
+    if (bf->items > card && bf->items - card > bf->items / 4) bf->stale = 1;
+  } else if (bf && !added) {
+    bf->stale = 1;
+  }
+  if (c->sig && !added) c->sig->stale = 1;
+
+  return REDISMODULE_OK;
+}
+
+/* Deletes the companions of the sets in a database, or in all of them if db
+ * is -1. */
+void companion_drop_db(int db) {
+  HashMapIterator it = HashMap_Iterate(set_companions);
+  HashMapEntry *e;
+  while ((e = HashMapIterator_Next(&it))) {
+    int edb;
+    memcpy(&edb, e->key, sizeof(int));
+    if (db != -1 && edb != db) continue;
+    void *c;
+    HashMap_Delete(set_companions, e->key, e->keylen, &c);
+    companion_free(c);
+  }
+}
+
+/* Moves the companions of two databases' sets along with them. */
+void companion_swap_dbs(int db1, int db2) {
+  size_t n = 0, size = HashMap_Size(set_companions);
+  char **regkeys = RedisModule_Alloc(size * sizeof(char *));
+  size_t *lens = RedisModule_Alloc(size * sizeof(size_t));
+  void **cs = RedisModule_Alloc(size * sizeof(void *));
+
+  HashMapIterator it = HashMap_Iterate(set_companions);
+  HashMapEntry *e;
+  while ((e = HashMapIterator_Next(&it))) {
+    int edb;
+    memcpy(&edb, e->key, sizeof(int));
+    if (edb != db1 && edb != db2) continue;
+    edb = (edb == db1 ? db2 : db1);
+    regkeys[n] = RedisModule_Alloc(e->keylen);
+    memcpy(regkeys[n], &edb, sizeof(int));
+    memcpy(regkeys[n] + sizeof(int), e->key + sizeof(int),
+           e->keylen - sizeof(int));
+    lens[n] = e->keylen;
+    HashMap_Delete(set_companions, e->key, e->keylen, &cs[n]);
+    n++;
+  }
+  for (size_t i = 0; i < n; i++) {
+    HashMap_Put(set_companions, regkeys[i], lens[i], cs[i]);
+    RedisModule_Free(regkeys[i]);
+  }
+  RedisModule_Free(regkeys);
+  RedisModule_Free(lens);
+  RedisModule_Free(cs);
+}
+
+/* Keeps the companions of sets current across the server events that
+ * replace sets without keyspace notifications: FLUSHDB and FLUSHALL drop
+ * them, SWAPDB swaps them, and loading a dataset (e.g. a replica's full
+ * resync) drops all of them. */
+void SetCompanionServerEvent(RedisModuleCtx *ctx, RedisModuleEvent eid,
+                             uint64_t subevent, void *data) {
+  if (eid.id == REDISMODULE_EVENT_FLUSHDB &&
+      subevent == REDISMODULE_SUBEVENT_FLUSHDB_START) {
+    companion_drop_db(((RedisModuleFlushInfo *)data)->dbnum);
+  } else if (eid.id == REDISMODULE_EVENT_SWAPDB) {
+    RedisModuleSwapDbInfo *info = data;
+    companion_swap_dbs(info->dbnum_first, info->dbnum_second);
+  } else if (eid.id == REDISMODULE_EVENT_LOADING &&
+             (subevent == REDISMODULE_SUBEVENT_LOADING_RDB_START ||
+              subevent == REDISMODULE_SUBEVENT_LOADING_AOF_START ||
+              subevent == REDISMODULE_SUBEVENT_LOADING_REPL_START)) {
+    companion_drop_db(-1);
+  }
+}
+
 /*
 * MSISMEMBER key1 [key2 ...] member
 * Checks for membership in multiple sets.
@@ -47,8 +431,7 @@ int MSIsMemberCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   size_t count = 0;
   int i;
   for (i = 1; i < iele; i++) {
-    RedisModuleKey *key =
-        RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ | REDISMODULE_WRITE);
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
 
     if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) continue;
 
@@ -57,17 +440,1102 @@ int MSIsMemberCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
       return REDISMODULE_ERR;
     }
 
+    /* The set's filter, if any, rejects most of the members it lacks. */
+    SBloom *bf = sbloom_get(ctx, argv[i]);
+    if (bf && !sbloom_maybe(bf, argv[iele])) continue;
+
     RedisModuleCallReply *rep =
         RedisModule_Call(ctx, "SISMEMBER", "ss", argv[i], argv[iele]);
     RMUTIL_ASSERT_NOERROR(rep)
 
-    count += RedisModule_CallReplyInteger(rep);
+    long long ismember = RedisModule_CallReplyInteger(rep);
+    if (bf && !ismember) bf->falsepositives++;
+    count += ismember;
   }
 
   RedisModule_ReplyWithLongLong(ctx, count);
   return REDISMODULE_OK;
 }
 
+/* Set once SMISMEMBER turns out to be missing from the server. */
+int smismember_missing = 0;
+
+/*
+* Looks up members in an open set, all at once with SMISMEMBER unless the
+* server lacks it. Members that the set's Bloom filter rejects aren't looked
+* up. found[i] is set to whether the i-th member is in the set.
+*/
+void sets_lookup(RedisModuleCtx *ctx, RedisModuleKey *key,
+                 RedisModuleString *keyname, RedisModuleString **members,
+                 size_t n, int *found) {
+  /* The members left to look up, and their positions. */
+  RedisModuleString **probes =
+      RedisModule_Alloc(n * sizeof(RedisModuleString *));
+  size_t *pos = RedisModule_Alloc(n * sizeof(size_t));
+  size_t nprobes = 0;
+  SBloom *bf = sbloom_get(ctx, keyname);
+  for (size_t i = 0; i < n; i++) {
+    found[i] = 0;
+    if (bf && !sbloom_maybe(bf, members[i])) continue;
+    probes[nprobes] = members[i];
+    pos[nprobes++] = i;
+  }
+
+  RedisModuleCallReply *rep = NULL;
+  if (nprobes && !smismember_missing) {
+    rep = RedisModule_Call(ctx, "SMISMEMBER", "sv", keyname, probes, nprobes);
+    if (RedisModule_CallReplyType(rep) != REDISMODULE_REPLY_ARRAY) {
+      smismember_missing = 1;
+      RedisModule_FreeCallReply(rep);
+      rep = NULL;
+    }
+  }
+  for (size_t i = 0; i < nprobes; i++) {
+    if (rep) {
+      found[pos[i]] = RedisModule_CallReplyInteger(
+          RedisModule_CallReplyArrayElement(rep, i));
+    } else {
+      RedisModuleCallReply *r =
+          RedisModule_Call(ctx, "SISMEMBER", "ss", keyname, probes[i]);
+      found[pos[i]] = RedisModule_CallReplyInteger(r);
+      RedisModule_FreeCallReply(r);
+    }
+    if (bf && !found[pos[i]]) bf->falsepositives++;
+  }
+  if (rep) RedisModule_FreeCallReply(rep);
+  RedisModule_Free(probes);
+  RedisModule_Free(pos);
+}
+
+/* Drops the records of members that aren't in the set anymore, and all but
+ * the newest record of members added more than once. */
+void sfifo_compact(RedisModuleCtx *ctx, SFifo *f, RedisModuleKey *key,
+                   RedisModuleString *keyname) {
+  size_t n = f->count;
+  RedisModuleString **members =
+      RedisModule_Alloc(n * sizeof(RedisModuleString *));
+  int *found = RedisModule_Alloc(n * sizeof(int));
+  int *newest = RedisModule_Alloc(n * sizeof(int));
+  for (size_t i = 0; i < n; i++) {
+    size_t len;
+    const char *ele = sfifo_pop(f, &len, &newest[i]);
+    members[i] = RedisModule_CreateString(ctx, ele, len);
+  }
+
+  sets_lookup(ctx, key, keyname, members, n, found);
+  f->head = f->used = 0;
+  for (size_t i = 0; i < n; i++) {
+    size_t len;
+    const char *ele = RedisModule_StringPtrLen(members[i], &len);
+    if (found[i] && newest[i]) sfifo_push(f, ele, len);
+    RedisModule_FreeString(ctx, members[i]);
+  }
+  RedisModule_Free(newest);
+  RedisModule_Free(members);
+  RedisModule_Free(found);
+}
+
+/*
+* SADDCAPPED key cap [RANDOM|OLDEST] member [member ...]
+* Adds members to a set, keeping it at `cap` cardinality by evicting random
+* members (the default) or the oldest ones. Insertion order is only known for
+* the members SADDCAPPED added with OLDEST, and other members are evicted
+* at random once these run out. With OLDEST, members that would be evicted
+* right away aren't added at all.
+* Reply: Integer, the number of members added.
+*/
+int SAddCappedCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
+  if (argc < 4) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  long long cap;
+  if ((RedisModule_StringToLongLong(argv[2], &cap) != REDISMODULE_OK) ||
+      (cap < 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid cap");
+    return REDISMODULE_ERR;
+  }
+
+  int oldest = 0, first = 3;
+  const char *policy = RedisModule_StringPtrLen(argv[3], NULL);
+  if (!strcasecmp(policy, "oldest")) {
+    oldest = 1;
+    first++;
+  } else if (!strcasecmp(policy, "random")) {
+    first++;
+  }
+  if (first == argc) return RedisModule_WrongArity(ctx);
+  if (oldest && !set_companions) {
+    RedisModule_ReplyWithError(ctx,
+                               "ERR OLDEST requires keyspace notifications");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_SET &&
+      RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleString **members = argv + first;
+  size_t nmembers = argc - first;
+  if (oldest) {
+    /* A member given more than once is only added at its last occurrence,
+     * and only the last cap members can survive evicting the oldest ones. */
+    RedisModuleString **last =
+        RedisModule_PoolAlloc(ctx, nmembers * sizeof(RedisModuleString *));
+    HashMap *seen = NewHashMap(nmembers);
+    size_t n = nmembers;
+    for (int i = argc - 1; i >= first && nmembers - n < (size_t)cap; i--) {
+      size_t len;
+      const char *ele = RedisModule_StringPtrLen(argv[i], &len);
+      int isnew;
+      HashMap_Insert(seen, ele, len, &isnew);
+      if (isnew) last[--n] = argv[i];
+    }
+    HashMap_Free(seen, NULL);
+    members = last + n;
+    nmembers -= n;
+  }
+
+  /* The new members are recorded in insertion order, so they are looked up
+   * before being added. */
+  int *found = NULL;
+  if (oldest) {
+    found = RedisModule_Alloc(nmembers * sizeof(int));
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_SET)
+      sets_lookup(ctx, key, argv[1], members, nmembers, found);
+    else
+      memset(found, 0, nmembers * sizeof(int));
+  }
+
+  RedisModuleCallReply *rep =
+      RedisModule_Call(ctx, "SADD", "sv", argv[1], members, nmembers);
+  RMUTIL_ASSERT_NOERROR(rep)
+  long long added = RedisModule_CallReplyInteger(rep);
+
+  /* Reopen the key, which SADD may have just created. */
+  key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  long long card = RedisModule_ValueLength(key);
+  SFifo *f = NULL;
+  if (oldest) {
+    int db = RedisModule_GetSelectedDb(ctx);
+    SetCompanion *c = companion_get(db, argv[1], 1);
+    if (!c->fifo) c->fifo = RedisModule_Calloc(1, sizeof(SFifo));
+    f = c->fifo;
+    for (size_t i = 0; i < nmembers; i++) {
+      if (found[i]) continue;
+      size_t len;
+      const char *ele = RedisModule_StringPtrLen(members[i], &len);
+      sfifo_push(f, ele, len);
+    }
+    RedisModule_Free(found);
+
+    /* Evict the oldest members, skipping those removed meanwhile and the
+     * records that aren't their members' newest. */
+    size_t len;
+    const char *ele;
+    int newest;
+    while (card > cap && (ele = sfifo_pop(f, &len, &newest))) {
+      if (!newest) continue;
+      RedisModuleCallReply *srem =
+          RedisModule_Call(ctx, "SREM", "sb", argv[1], ele, len);
+      card -= RedisModule_CallReplyInteger(srem);
+      RedisModule_FreeCallReply(srem);
+    }
+    if (f->count > (size_t)cap * 2 + 16)
+      sfifo_compact(ctx, f, key, argv[1]);
+  }
+  if (card > cap) {
+    RedisModuleCallReply *spop =
+        RedisModule_Call(ctx, "SPOP", "sl", argv[1], card - cap);
+    RMUTIL_ASSERT_NOERROR(spop)
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, added);
+  return REDISMODULE_OK;
+}
+
+/*
+* MSISMEMBERX numkeys key [key ...] member [member ...]
+* Checks for the membership of multiple members in multiple sets. Each set is
+* probed once for all the members with SMISMEMBER, falling back to SISMEMBER
+* on servers that lack it. Members that a set's Bloom filter rejects aren't
+* probed at all.
+* Reply: Bulk string, a bitmap of the membership matrix in rows of keys. The
+* bit of the i-th key and j-th member (zero-based) is at offset
+* `i * members + j`, in the order GETBIT uses.
+*/
+int MSIsMemberXCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc) {
+  long long numkeys;
+  if ((argc < 4) ||
+      (RedisModule_StringToLongLong(argv[1], &numkeys) != REDISMODULE_OK) ||
+      (numkeys < 1) || (numkeys > argc - 3)) {
+    if (RedisModule_IsKeysPositionRequest(ctx))
+      /* TODO: handle this once the getkey-api allows signalling errors */
+      return REDISMODULE_OK;
+    else if (argc < 4)
+      return RedisModule_WrongArity(ctx);
+    RedisModule_ReplyWithError(ctx, "ERR invalid numkeys");
+    return REDISMODULE_ERR;
+  }
+
+  if (RedisModule_IsKeysPositionRequest(ctx)) {
+    for (int i = 2; i < 2 + numkeys; i++) RedisModule_KeyAtPos(ctx, i);
+    return REDISMODULE_OK;
+  }
+
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleString **members = argv + 2 + numkeys;
+  size_t nmembers = argc - 2 - numkeys;
+  size_t len = (numkeys * nmembers + 7) / 8;
+  unsigned char *bitmap = RedisModule_Calloc(len, 1);
+  int *found = RedisModule_Alloc(nmembers * sizeof(int));
+  for (int i = 0; i < numkeys; i++) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[2 + i],
+                                              REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) continue;
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_SET) {
+      RedisModule_Free(bitmap);
+      RedisModule_Free(found);
+      RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+      return REDISMODULE_ERR;
+    }
+
+    sets_lookup(ctx, key, argv[2 + i], members, nmembers, found);
+    for (size_t j = 0; j < nmembers; j++) {
+      size_t bit = i * nmembers + j;
+      if (found[j]) bitmap[bit / 8] |= 0x80 >> (bit % 8);
+    }
+  }
+  RedisModule_Free(found);
+
+  RedisModule_ReplyWithStringBuffer(ctx, (char *)bitmap, len);
+  RedisModule_Free(bitmap);
+  return REDISMODULE_OK;
+}
+
+/* A set of SINTERCARDX, with how selective it has been so far. */
+typedef struct {
+  RedisModuleString *keyname;
+  RedisModuleKey *key;
+  size_t card;
+  long long probed, rejected;
+} SInterSet;
+
+int sinter_cardcmp(const void *p1, const void *p2) {
+  const SInterSet *s1 = p1, *s2 = p2;
+  return (s1->card > s2->card) - (s1->card < s2->card);
+}
+
+/* Orders the sets probed so that the ones that rejected most of their
+ * probes so far come first, and the smaller ones on ties. */
+int sinter_rejectcmp(const void *p1, const void *p2) {
+  const SInterSet *s1 = p1, *s2 = p2;
+  double r1 = (s1->probed ? (double)s1->rejected / s1->probed : 0);
+  double r2 = (s2->probed ? (double)s2->rejected / s2->probed : 0);
+  if (r1 != r2) return (r1 < r2) - (r1 > r2);
+  return sinter_cardcmp(p1, p2);
+}
+
+/*
+* SINTERCARDX numkeys key [key ...] [LIMIT limit]
+* Counts the members in the intersection of sets without building it. The
+* smallest set is scanned and its members are looked up in the others, in
+* batches and starting with the sets that rejected most members so far.
+* Counting stops as soon as `limit` is reached, if it isn't 0.
+* Reply: Integer, the intersection's cardinality, up to `limit`.
+*/
+int SInterCardXCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc) {
+  long long numkeys;
+  if ((argc < 3) ||
+      (RedisModule_StringToLongLong(argv[1], &numkeys) != REDISMODULE_OK) ||
+      (numkeys < 1) || (numkeys > argc - 2)) {
+    if (RedisModule_IsKeysPositionRequest(ctx))
+      /* TODO: handle this once the getkey-api allows signalling errors */
+      return REDISMODULE_OK;
+    else if (argc < 3)
+      return RedisModule_WrongArity(ctx);
+    RedisModule_ReplyWithError(ctx, "ERR invalid numkeys");
+    return REDISMODULE_ERR;
+  }
+
+  if (RedisModule_IsKeysPositionRequest(ctx)) {
+    for (int i = 2; i < 2 + numkeys; i++) RedisModule_KeyAtPos(ctx, i);
+    return REDISMODULE_OK;
+  }
+
+  RedisModule_AutoMemory(ctx);
+
+  long long limit = 0;
+  int iarg = 2 + numkeys;
+  if (iarg < argc) {
+    if ((argc - iarg != 2) ||
+        strcasecmp("limit", RedisModule_StringPtrLen(argv[iarg], NULL))) {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
+    }
+    if ((RedisModule_StringToLongLong(argv[iarg + 1], &limit) !=
+         REDISMODULE_OK) ||
+        (limit < 0)) {
+      RedisModule_ReplyWithError(ctx, "ERR invalid limit");
+      return REDISMODULE_ERR;
+    }
+  }
+
+  /* Open the sets, skipping repeated keys. Any empty set means an empty
+   * intersection, but all keys are type checked first. */
+  SInterSet *sets = RedisModule_Calloc(numkeys, sizeof(SInterSet));
+  int nsets = 0, empty = 0;
+  for (int i = 2; i < 2 + numkeys; i++) {
+    size_t len;
+    const char *name = RedisModule_StringPtrLen(argv[i], &len);
+    int repeated = 0;
+    for (int j = 0; j < nsets && !repeated; j++) {
+      size_t jlen;
+      const char *jname = RedisModule_StringPtrLen(sets[j].keyname, &jlen);
+      repeated = (len == jlen && !memcmp(name, jname, len));
+    }
+    if (repeated) continue;
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
+    int type = RedisModule_KeyType(key);
+    if (type != REDISMODULE_KEYTYPE_SET && type != REDISMODULE_KEYTYPE_EMPTY) {
+      RedisModule_Free(sets);
+      RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+      return REDISMODULE_ERR;
+    }
+    if (type == REDISMODULE_KEYTYPE_EMPTY) empty = 1;
+    sets[nsets].keyname = argv[i];
+    sets[nsets].key = key;
+    sets[nsets++].card = RedisModule_ValueLength(key);
+  }
+
+  qsort(sets, nsets, sizeof(SInterSet), sinter_cardcmp);
+  long long count = 0;
+  if (empty) {
+    count = 0;
+  } else if (nsets == 1) {
+    count = sets[0].card;
+  } else {
+    RedisModuleString *scursor = RedisModule_CreateStringFromLongLong(ctx, 0);
+    long long lcursor;
+    do {
+      RedisModuleCallReply *rep =
+          RedisModule_Call(ctx, "SSCAN", "sscc", sets[0].keyname, scursor,
+                           "COUNT", "100");
+      RedisModule_FreeString(ctx, scursor);
+      scursor = RedisModule_CreateStringFromCallReply(
+          RedisModule_CallReplyArrayElement(rep, 0));
+      RedisModule_StringToLongLong(scursor, &lcursor);
+
+      RedisModuleCallReply *rmembers =
+          RedisModule_CallReplyArrayElement(rep, 1);
+      size_t n = RedisModule_CallReplyLength(rmembers);
+      if (!n) {
+        RedisModule_FreeCallReply(rep);
+        continue;
+      }
+      RedisModuleString **members =
+          RedisModule_Alloc(n * sizeof(RedisModuleString *));
+      int *found = RedisModule_Alloc(n * sizeof(int));
+      for (size_t i = 0; i < n; i++)
+        members[i] = RedisModule_CreateStringFromCallReply(
+            RedisModule_CallReplyArrayElement(rmembers, i));
+      RedisModule_FreeCallReply(rep);
+
+      /* Narrow the batch down set by set, keeping the members found. */
+      size_t left = n;
+      for (int j = 1; j < nsets && left; j++) {
+        sets_lookup(ctx, sets[j].key, sets[j].keyname, members, left, found);
+        size_t kept = 0;
+        for (size_t i = 0; i < left; i++) {
+          if (found[i])
+            members[kept++] = members[i];
+          else
+            RedisModule_FreeString(ctx, members[i]);
+        }
+        sets[j].probed += left;
+        sets[j].rejected += left - kept;
+        left = kept;
+      }
+      for (size_t i = 0; i < left; i++) RedisModule_FreeString(ctx, members[i]);
+      RedisModule_Free(members);
+      RedisModule_Free(found);
+
+      count += left;
+      qsort(sets + 1, nsets - 1, sizeof(SInterSet), sinter_rejectcmp);
+    } while (lcursor && (!limit || count < limit));
+    RedisModule_FreeString(ctx, scursor);
+  }
+  RedisModule_Free(sets);
+
+  if (limit && count > limit) count = limit;
+  RedisModule_ReplyWithLongLong(ctx, count);
+  return REDISMODULE_OK;
+}
+
+static inline uint64_t ssig_mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+void ssig_add(SSig *sig, const char *ele, size_t len) {
+  uint64_t h = HashMap_Hash(ele, len);
+  for (int i = 0; i < sig->k; i++) {
+    uint64_t v = ssig_mix(h + i * 0x9E3779B97F4A7C15ULL);
+    if (v < sig->mins[i]) sig->mins[i] = v;
+  }
+}
+
+/* ssig_add() as a SetsScanFunc. */
+void ssig_add_scanned(void *privdata, const char *ele, size_t len) {
+  ssig_add(privdata, ele, len);
+}
+
+void ssig_build(RedisModuleCtx *ctx, SSig *sig, RedisModuleString *keyname) {
+  for (int i = 0; i < sig->k; i++) sig->mins[i] = UINT64_MAX;
+  sig->stale = 0;
+  sets_scan(ctx, keyname, ssig_add_scanned, sig);
+}
+
+/* Returns the signature of a set, which may be stale, or NULL if the set has
+ * none or doesn't exist anymore. */
+SSig *ssig_get(RedisModuleCtx *ctx, RedisModuleString *keyname) {
+  if (!set_companions || !HashMap_Size(set_companions)) return NULL;
+  SetCompanion *c =
+      companion_get(RedisModule_GetSelectedDb(ctx), keyname, 0);
+  if (!c || !c->sig) return NULL;
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+  int type = RedisModule_KeyType(key);
+  RedisModule_CloseKey(key);
+  if (type != REDISMODULE_KEYTYPE_SET) return NULL;
+  return c->sig;
+}
+
+/* Estimates the Jaccard similarity of two sets as the share of their
+ * signatures' hash functions that have the same minimum. The loop compares
+ * plain words so that the compiler can vectorize it. */
+double ssig_similarity(const SSig *a, const SSig *b) {
+  int same = 0;
+  for (int i = 0; i < a->k; i++)
+    same += (a->mins[i] == b->mins[i]) & (a->mins[i] != UINT64_MAX);
+  return (double)same / a->k;
+}
+
+/*
+* SSIG.BUILD key k
+* Builds a MinHash signature of a set, made of `k` hashes, from which SSIM
+* and STOPSIMILAR estimate its similarity to other sets. Members added with
+* SBLOOM.SADD are added to the signature, and other changes to the set make
+* it stale until it is built again. The set must exist. Signatures are kept
+* in memory only and are lost on restart.
+* Reply: Integer, the number of members in the set.
+*/
+int SSigBuildCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                     int argc) {
+  if (argc != 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  long long k;
+  if ((RedisModule_StringToLongLong(argv[2], &k) != REDISMODULE_OK) ||
+      (k < 1) || (k > SSIG_MAX_K)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid k");
+    return REDISMODULE_ERR;
+  }
+
+  /* Companions of missing keys would never be deleted. */
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModule_ReplyWithError(ctx, "ERR no such key");
+    return REDISMODULE_ERR;
+  }
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_SET) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  SetCompanion *c = companion_get(RedisModule_GetSelectedDb(ctx), argv[1], 1);
+  ssig_free(c->sig);
+  c->sig = RedisModule_Alloc(sizeof(SSig));
+  c->sig->k = k;
+  c->sig->mins = RedisModule_Alloc(k * sizeof(uint64_t));
+  ssig_build(ctx, c->sig, argv[1]);
+
+  RedisModule_ReplyWithLongLong(ctx, RedisModule_ValueLength(key));
+  return REDISMODULE_OK;
+}
+
+/*
+* SSIM key1 key2
+* Estimates the Jaccard similarity of two sets from their signatures, in
+* O(k). Both sets need current signatures of the same size: stale ones are
+* rejected rather than rebuilt.
+* Reply: Bulk string, the similarity, between 0 and 1.
+*/
+int SSimCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  SSig *a = ssig_get(ctx, argv[1]), *b = ssig_get(ctx, argv[2]);
+  if (!a || !b) {
+    RedisModule_ReplyWithError(ctx, "ERR no signature for key");
+    return REDISMODULE_ERR;
+  }
+  if (a->stale || b->stale) {
+    RedisModule_ReplyWithError(ctx, "ERR stale signature, rebuild it");
+    return REDISMODULE_ERR;
+  }
+  if (a->k != b->k) {
+    RedisModule_ReplyWithError(ctx, "ERR signatures differ in size");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModule_ReplyWithDouble(ctx, ssig_similarity(a, b));
+  return REDISMODULE_OK;
+}
+
+/* A candidate of STOPSIMILAR. */
+typedef struct {
+  int arg;
+  double similarity;
+} SSimCandidate;
+
+/* Orders candidates from the most similar, then by their order in the
+ * arguments. */
+int ssim_candidatecmp(const void *p1, const void *p2) {
+  const SSimCandidate *c1 = p1, *c2 = p2;
+  if (c1->similarity != c2->similarity)
+    return (c1->similarity < c2->similarity) -
+           (c1->similarity > c2->similarity);
+  return c1->arg - c2->arg;
+}
+
+/*
+* STOPSIMILAR k key candidate [candidate ...]
+* Ranks candidate sets by their estimated Jaccard similarity to a set, from
+* their signatures. The set's signature must be current, and candidates
+* without a current signature of the same size as the set's are skipped, so
+* that no signature is rebuilt here.
+* Reply: Array of up to `k` candidates and their similarities, from the most
+* similar.
+*/
+int STopSimilarCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc) {
+  if (argc < 4) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  long long k;
+  if ((RedisModule_StringToLongLong(argv[1], &k) != REDISMODULE_OK) ||
+      (k < 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid k");
+    return REDISMODULE_ERR;
+  }
+
+  SSig *sig = ssig_get(ctx, argv[2]);
+  if (!sig) {
+    RedisModule_ReplyWithError(ctx, "ERR no signature for key");
+    return REDISMODULE_ERR;
+  }
+  if (sig->stale) {
+    RedisModule_ReplyWithError(ctx, "ERR stale signature, rebuild it");
+    return REDISMODULE_ERR;
+  }
+
+  SSimCandidate *cands =
+      RedisModule_Alloc((argc - 3) * sizeof(SSimCandidate));
+  int ncands = 0;
+  for (int i = 3; i < argc; i++) {
+    SSig *csig = ssig_get(ctx, argv[i]);
+    if (!csig || csig->stale || csig->k != sig->k) continue;
+    cands[ncands].arg = i;
+    cands[ncands++].similarity = ssig_similarity(sig, csig);
+  }
+  qsort(cands, ncands, sizeof(SSimCandidate), ssim_candidatecmp);
+
+  if (k > ncands) k = ncands;
+  RedisModule_ReplyWithArray(ctx, k * 2);
+  for (int i = 0; i < k; i++) {
+    RedisModule_ReplyWithString(ctx, argv[cands[i].arg]);
+    RedisModule_ReplyWithDouble(ctx, cands[i].similarity);
+  }
+  RedisModule_Free(cands);
+
+  return REDISMODULE_OK;
+}
+
+/*
+* SBLOOM.ENABLE key fp-rate
+* Attaches a Bloom filter to a set, sized for the given false positive rate,
+* that MSISMEMBER and MSISMEMBERX consult before looking up the set. Members
+* added with SBLOOM.SADD are added to the filter, and other changes to the
+* set make it stale: it is then bypassed until SBLOOM.ENABLE or SBLOOM.SADD
+* rebuilds it.
+* The set must exist. Filters are kept in memory only and are lost on restart.
+* Reply: Integer, the number of members in the filter.
+*/
+int SBloomEnableCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                        int argc) {
+  if (argc != 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  double fprate;
+  if ((RedisModule_StringToDouble(argv[2], &fprate) != REDISMODULE_OK) ||
+      (fprate <= 0) || (fprate >= 1)) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid fp-rate");
+    return REDISMODULE_ERR;
+  }
+
+  /* Companions of missing keys would never be deleted. */
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModule_ReplyWithError(ctx, "ERR no such key");
+    return REDISMODULE_ERR;
+  }
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_SET) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  SetCompanion *c = companion_get(RedisModule_GetSelectedDb(ctx), argv[1], 1);
+  if (c->bloom)
+    c->bloom->rebuilds++;
+  else
+    c->bloom = RedisModule_Calloc(1, sizeof(SBloom));
+  c->bloom->fprate = fprate;
+  sbloom_build(ctx, c->bloom, key, argv[1]);
+
+  RedisModule_ReplyWithLongLong(ctx, c->bloom->items);
+  return REDISMODULE_OK;
+}
+
+/*
+* SBLOOM.DISABLE key
+* Detaches a set's Bloom filter.
+* Reply: Integer, 1 if the set had a filter, 0 otherwise.
+*/
+int SBloomDisableCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                         int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  int db = RedisModule_GetSelectedDb(ctx);
+  SetCompanion *c = companion_get(db, argv[1], 0);
+  int disabled = (c && c->bloom);
+  if (disabled) {
+    sbloom_free(c->bloom);
+    c->bloom = NULL;
+    companion_release(db, argv[1]);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, disabled);
+  return REDISMODULE_OK;
+}
+
+/*
+* SBLOOM.SADD key member [member ...]
+* Adds members to a set like SADD, and to its Bloom filter and signature,
+* keeping them current. A stale or full filter is rebuilt here, so that the
+* filters of sets that other commands change get back in use without reads
+* ever scanning the set.
+* Reply: Integer, the number of members added to the set.
+*/
+int SBloomSAddCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
+  if (argc < 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  companion_adding = 1;
+  RedisModuleCallReply *rep =
+      RedisModule_Call(ctx, "SADD", "sv", argv[1], argv + 2, argc - 2);
+  companion_adding = 0;
+  RMUTIL_ASSERT_NOERROR(rep)
+
+  long long added = RedisModule_CallReplyInteger(rep);
+  SetCompanion *c =
+      companion_get(RedisModule_GetSelectedDb(ctx), argv[1], 0);
+  if (c && c->bloom && !c->bloom->stale) {
+    for (int i = 2; i < argc; i++) {
+      size_t len;
+      const char *ele = RedisModule_StringPtrLen(argv[i], &len);
+      sbloom_add(c->bloom, ele, len);
+    }
+    c->bloom->items += added;
+  }
+  if (c && c->bloom &&
+      (c->bloom->stale || c->bloom->items > c->bloom->capacity)) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    sbloom_build(ctx, c->bloom, key, argv[1]);
+    c->bloom->rebuilds++;
+  }
+  if (c && c->sig && !c->sig->stale) {
+    for (int i = 2; i < argc; i++) {
+      size_t len;
+      const char *ele = RedisModule_StringPtrLen(argv[i], &len);
+      ssig_add(c->sig, ele, len);
+    }
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, added);
+  return REDISMODULE_OK;
+}
+
+/*
+* SBLOOM.STATS key
+* Reply: Array of the set's Bloom filter statistics, as name and value
+* pairs. `negatives` counts the probes the filter rejected, and
+* `false-positives` the probes it let through for members the set lacks.
+*/
+int SBloomStatsCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                       int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  SetCompanion *c =
+      companion_get(RedisModule_GetSelectedDb(ctx), argv[1], 0);
+  if (!c || !c->bloom) {
+    RedisModule_ReplyWithError(ctx, "ERR no filter for key");
+    return REDISMODULE_ERR;
+  }
+
+  SBloom *bf = c->bloom;
+  RedisModule_ReplyWithArray(ctx, 20);
+  RedisModule_ReplyWithSimpleString(ctx, "fp-rate");
+  RedisModule_ReplyWithDouble(ctx, bf->fprate);
+  RedisModule_ReplyWithSimpleString(ctx, "capacity");
+  RedisModule_ReplyWithLongLong(ctx, bf->capacity);
+  RedisModule_ReplyWithSimpleString(ctx, "items");
+  RedisModule_ReplyWithLongLong(ctx, bf->items);
+  RedisModule_ReplyWithSimpleString(ctx, "bytes");
+  RedisModule_ReplyWithLongLong(ctx, bf->nblocks * SBLOOM_BLOCK_BITS / 8);
+  RedisModule_ReplyWithSimpleString(ctx, "hashes");
+  RedisModule_ReplyWithLongLong(ctx, bf->hashes);
+  RedisModule_ReplyWithSimpleString(ctx, "stale");
+  RedisModule_ReplyWithLongLong(ctx, bf->stale);
+  RedisModule_ReplyWithSimpleString(ctx, "probes");
+  RedisModule_ReplyWithLongLong(ctx, bf->probes);
+  RedisModule_ReplyWithSimpleString(ctx, "negatives");
+  RedisModule_ReplyWithLongLong(ctx, bf->negatives);
+  RedisModule_ReplyWithSimpleString(ctx, "false-positives");
+  RedisModule_ReplyWithLongLong(ctx, bf->falsepositives);
+  RedisModule_ReplyWithSimpleString(ctx, "rebuilds");
+  RedisModule_ReplyWithLongLong(ctx, bf->rebuilds);
+
+  return REDISMODULE_OK;
+}
+
+#define RSET_ENCODING_VERSION 0
+/* Values per RSET.ADD emitted when rewriting the AOF. */
+#define RSET_AOF_BATCH 1024
+
+/* Sets of 32 bit integers, as roaring bitmaps. */
+RedisModuleType *RSetType = NULL;
+
+void RSetFree(void *value) { Roaring_Free(value); }
+
+size_t RSetMemUsage(const void *value) { return Roaring_MemUsage(value); }
+
+void RSetRdbSave(RedisModuleIO *rdb, void *value) {
+  Roaring *r = value;
+  RedisModule_SaveUnsigned(rdb, r->len);
+  for (size_t i = 0; i < r->len; i++) {
+    RoaringContainer *c = r->containers + i;
+    RedisModule_SaveUnsigned(rdb, c->key);
+    RedisModule_SaveUnsigned(rdb, c->card);
+    if (c->bitmap)
+      RedisModule_SaveStringBuffer(rdb, (char *)c->bitmap,
+                                   ROARING_BITMAP_WORDS * sizeof(uint64_t));
+    else
+      RedisModule_SaveStringBuffer(rdb, (char *)c->array,
+                                   c->card * sizeof(uint16_t));
+  }
+}
+
+void *RSetRdbLoad(RedisModuleIO *rdb, int encver) {
+  if (encver != RSET_ENCODING_VERSION) return NULL;
+
+  Roaring *r = NewRoaring();
+  size_t len = RedisModule_LoadUnsigned(rdb);
+  while (len--) {
+    uint16_t key = RedisModule_LoadUnsigned(rdb);
+    uint32_t card = RedisModule_LoadUnsigned(rdb);
+    size_t blen;
+    char *buf = RedisModule_LoadStringBuffer(rdb, &blen);
+    Roaring_AppendContainer(r, key, card, buf);
+    RedisModule_Free(buf);
+  }
+  return r;
+}
+
+void RSetAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+  Roaring *r = value;
+  uint32_t *values = RedisModule_Alloc(65536 * sizeof(uint32_t));
+  RedisModuleString **args =
+      RedisModule_Alloc(RSET_AOF_BATCH * sizeof(RedisModuleString *));
+  size_t nargs = 0;
+  for (size_t i = 0; i < r->len; i++) {
+    RoaringContainer *c = r->containers + i;
+    RoaringContainer_Values(c, values);
+    for (uint32_t j = 0; j < c->card; j++) {
+      args[nargs++] = RedisModule_CreateStringFromLongLong(NULL, values[j]);
+      if (nargs == RSET_AOF_BATCH) {
+        RedisModule_EmitAOF(aof, "RSET.ADD", "sv", key, args, nargs);
+        while (nargs) RedisModule_FreeString(NULL, args[--nargs]);
+      }
+    }
+  }
+  if (nargs) {
+    RedisModule_EmitAOF(aof, "RSET.ADD", "sv", key, args, nargs);
+    while (nargs) RedisModule_FreeString(NULL, args[--nargs]);
+  }
+  RedisModule_Free(args);
+  RedisModule_Free(values);
+}
+
+/* Parses a member of an integer set, which is between 0 and 2^32-1. */
+int rset_parse_id(RedisModuleString *arg, uint32_t *id) {
+  long long lid;
+  if ((RedisModule_StringToLongLong(arg, &lid) != REDISMODULE_OK) ||
+      (lid < 0) || (lid > UINT32_MAX))
+    return REDISMODULE_ERR;
+  *id = lid;
+  return REDISMODULE_OK;
+}
+
+/*
+* RSET.ADD key id [id ...]
+* Adds integers between 0 and 2^32-1 to an integer set, creating it if
+* needed.
+* Reply: Integer, the number of ids added.
+*/
+int RSetAddCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  for (int i = 2; i < argc; i++) {
+    uint32_t id;
+    if (rset_parse_id(argv[i], &id) != REDISMODULE_OK) {
+      RedisModule_ReplyWithError(ctx, "ERR invalid id");
+      return REDISMODULE_ERR;
+    }
+  }
+
+  RedisModuleKey *key = RMUtil_OpenModuleKey(
+      ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE, RSetType);
+  if (!key) return REDISMODULE_ERR;
+  Roaring *r = RedisModule_ModuleTypeGetValue(key);
+  if (!r) {
+    r = NewRoaring();
+    RedisModule_ModuleTypeSetValue(key, RSetType, r);
+  }
+
+  long long added = 0;
+  for (int i = 2; i < argc; i++) {
+    uint32_t id;
+    rset_parse_id(argv[i], &id);
+    added += Roaring_Add(r, id);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, added);
+  return REDISMODULE_OK;
+}
+
+/*
+* RSET.ISMEMBER key id
+* Reply: Integer, 1 if the id is in the integer set, 0 otherwise.
+*/
+int RSetIsMemberCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                        int argc) {
+  if (argc != 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  uint32_t id;
+  if (rset_parse_id(argv[2], &id) != REDISMODULE_OK) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid id");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key =
+      RMUtil_OpenModuleKey(ctx, argv[1], REDISMODULE_READ, RSetType);
+  if (!key) return REDISMODULE_ERR;
+  Roaring *r = RedisModule_ModuleTypeGetValue(key);
+
+  RedisModule_ReplyWithLongLong(ctx, r ? Roaring_Contains(r, id) : 0);
+  return REDISMODULE_OK;
+}
+
+/*
+* RSET.CARD key
+* Reply: Integer, the number of ids in the integer set.
+*/
+int RSetCardCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key =
+      RMUtil_OpenModuleKey(ctx, argv[1], REDISMODULE_READ, RSetType);
+  if (!key) return REDISMODULE_ERR;
+  Roaring *r = RedisModule_ModuleTypeGetValue(key);
+
+  RedisModule_ReplyWithLongLong(ctx, r ? Roaring_Card(r) : 0);
+  return REDISMODULE_OK;
+}
+
+/* Stores an integer set, or deletes the key if it's empty, and replies with
+ * its cardinality. */
+void rset_store(RedisModuleCtx *ctx, RedisModuleString *keyname, Roaring *r) {
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+  uint64_t card = Roaring_Card(r);
+  if (card) {
+    RedisModule_ModuleTypeSetValue(key, RSetType, r);
+  } else {
+    RedisModule_DeleteKey(key);
+    Roaring_Free(r);
+  }
+  RedisModule_ReplyWithLongLong(ctx, card);
+}
+
+int rset_cardcmp(const void *p1, const void *p2) {
+  uint64_t c1 = Roaring_Card(*(Roaring **)p1);
+  uint64_t c2 = Roaring_Card(*(Roaring **)p2);
+  return (c1 > c2) - (c1 < c2);
+}
+
+/*
+* RSET.AND|RSET.OR|RSET.ANDNOT dest key [key ...]
+* Stores the intersection, union or difference of integer sets in dest. The
+* difference is of the first set and all the others. Missing keys are empty
+* sets, and an empty result deletes dest.
+* Reply: Integer, the cardinality of the result.
+*/
+int RSetOpGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                         int argc) {
+  if (argc < 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  const char *cmd = RedisModule_StringPtrLen(argv[0], NULL);
+  Roaring *(*op)(const Roaring *, const Roaring *) = Roaring_Or;
+  if (!strcasecmp(cmd, "rset.and"))
+    op = Roaring_And;
+  else if (!strcasecmp(cmd, "rset.andnot"))
+    op = Roaring_AndNot;
+
+  int nsrcs = argc - 2;
+  Roaring **srcs = RedisModule_Calloc(nsrcs, sizeof(Roaring *));
+  Roaring *empty = NewRoaring();
+  for (int i = 0; i < nsrcs; i++) {
+    RedisModuleKey *key =
+        RMUtil_OpenModuleKey(ctx, argv[2 + i], REDISMODULE_READ, RSetType);
+    if (!key) {
+      RedisModule_Free(srcs);
+      Roaring_Free(empty);
+      return REDISMODULE_ERR;
+    }
+    srcs[i] = RedisModule_ModuleTypeGetValue(key);
+    if (!srcs[i]) srcs[i] = empty;
+  }
+
+  /* Intersections start with the smallest sets, to shrink the fastest. */
+  if (op == Roaring_And) qsort(srcs, nsrcs, sizeof(Roaring *), rset_cardcmp);
+  Roaring *r = Roaring_Copy(srcs[0]);
+  for (int i = 1; i < nsrcs && (r->len || op == Roaring_Or); i++) {
+    Roaring *next = op(r, srcs[i]);
+    Roaring_Free(r);
+    r = next;
+  }
+  RedisModule_Free(srcs);
+  Roaring_Free(empty);
+
+  rset_store(ctx, argv[1], r);
+  return REDISMODULE_OK;
+}
+
+/*
+* RSET.IMPORT key set
+* Adds the members of a Redis Set to an integer set, creating it if needed.
+* All the members must be integers between 0 and 2^32-1, otherwise nothing
+* is added.
+* Reply: Integer, the number of ids added.
+*/
+int RSetImportCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
+  if (argc != 3) return RedisModule_WrongArity(ctx);
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key =
+      RMUtil_OpenModuleKey(ctx, argv[1], REDISMODULE_READ, RSetType);
+  if (!key) return REDISMODULE_ERR;
+  Roaring *r = RedisModule_ModuleTypeGetValue(key);
+  RedisModuleKey *skey = RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ);
+  if (RedisModule_KeyType(skey) != REDISMODULE_KEYTYPE_SET &&
+      RedisModule_KeyType(skey) != REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  Roaring *imported = NewRoaring();
+  int valid = 1;
+  if (RedisModule_KeyType(skey) == REDISMODULE_KEYTYPE_SET) {
+    RedisModuleString *scursor = RedisModule_CreateStringFromLongLong(ctx, 0);
+    long long lcursor;
+    do {
+      RedisModuleCallReply *rep = RedisModule_Call(
+          ctx, "SSCAN", "sscc", argv[2], scursor, "COUNT", "1000");
+      RedisModule_FreeString(ctx, scursor);
+      scursor = RedisModule_CreateStringFromCallReply(
+          RedisModule_CallReplyArrayElement(rep, 0));
+      RedisModule_StringToLongLong(scursor, &lcursor);
+
+      RedisModuleCallReply *rmembers =
+          RedisModule_CallReplyArrayElement(rep, 1);
+      size_t nmembers = RedisModule_CallReplyLength(rmembers);
+      for (size_t i = 0; i < nmembers && valid; i++) {
+        RedisModuleString *member = RedisModule_CreateStringFromCallReply(
+            RedisModule_CallReplyArrayElement(rmembers, i));
+        uint32_t id;
+        valid = (rset_parse_id(member, &id) == REDISMODULE_OK);
+        if (valid) Roaring_Add(imported, id);
+        RedisModule_FreeString(ctx, member);
+      }
+      RedisModule_FreeCallReply(rep);
+    } while (valid && lcursor);
+    RedisModule_FreeString(ctx, scursor);
+  }
+  if (!valid) {
+    Roaring_Free(imported);
+    RedisModule_ReplyWithError(ctx, "ERR set has non integer members");
+    return REDISMODULE_ERR;
+  }
+
+  uint64_t card = (r ? Roaring_Card(r) : 0);
+  Roaring *merged = imported;
+  if (r) {
+    merged = Roaring_Or(r, imported);
+    Roaring_Free(imported);
+  }
+  uint64_t added = Roaring_Card(merged) - card;
+  if (Roaring_Card(merged)) {
+    RedisModuleKey *key = RedisModule_OpenKey(
+        ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    RedisModule_ModuleTypeSetValue(key, RSetType, merged);
+  } else {
+    Roaring_Free(merged);
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, added);
+  return REDISMODULE_OK;
+}
+
 int testMSIsMember(RedisModuleCtx *ctx) {
   RedisModuleCallReply *r;
 
@@ -88,6 +1556,277 @@ int testMSIsMember(RedisModuleCtx *ctx) {
   return 0;
 }
 
+int testMSIsMemberX(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+  size_t len;
+  const char *bitmap;
+
+  r = RedisModule_Call(ctx, "SADD", "ccc", "s1", "a", "c");
+  r = RedisModule_Call(ctx, "SADD", "cc", "s3", "b");
+  r = RedisModule_Call(ctx, "msismemberx", "cccccccc", "3", "s1", "s2", "s3",
+                       "a", "b", "c", "d");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_STRING);
+  bitmap = RedisModule_CallReplyStringPtr(r, &len);
+  RMUtil_Assert(len == 2);
+  RMUtil_Assert((unsigned char)bitmap[0] == 0xa0);
+  RMUtil_Assert((unsigned char)bitmap[1] == 0x40);
+  r = RedisModule_Call(ctx, "msismemberx", "ccc", "2", "s1", "a");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "SET", "cc", "foo", "bar");
+  r = RedisModule_Call(ctx, "msismemberx", "ccc", "1", "foo", "a");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testSBloom(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "SADD", "ccc", "s1", "a", "b");
+  r = RedisModule_Call(ctx, "sbloom.enable", "cc", "s1", "0.01");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "sbloom.sadd", "ccc", "s1", "c", "a");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "msismember", "cc", "s1", "c");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "msismemberx", "ccccc", "1", "s1", "a", "x", "c");
+  RMUtil_Assert((unsigned char)RedisModule_CallReplyStringPtr(r, NULL)[0] ==
+                0xa0);
+  r = RedisModule_Call(ctx, "sbloom.stats", "c", "s1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 20);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 5)) == 3);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 11)) == 0);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 13)) == 4);
+
+  /* Plain additions make the filter stale, and it is bypassed until it is
+   * enabled again. */
+  r = RedisModule_Call(ctx, "SADD", "cc", "s1", "d");
+  r = RedisModule_Call(ctx, "msismember", "cc", "s1", "d");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "sbloom.stats", "c", "s1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 11)) == 1);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 13)) == 4);
+  r = RedisModule_Call(ctx, "sbloom.enable", "cc", "s1", "0.01");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 4);
+  r = RedisModule_Call(ctx, "sbloom.stats", "c", "s1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 11)) == 0);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 19)) == 1);
+
+  /* SBLOOM.SADD rebuilds stale filters too. */
+  r = RedisModule_Call(ctx, "SADD", "cc", "s1", "e");
+  r = RedisModule_Call(ctx, "sbloom.sadd", "cc", "s1", "f");
+  r = RedisModule_Call(ctx, "sbloom.stats", "c", "s1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 5)) == 6);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 11)) == 0);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 19)) == 2);
+  r = RedisModule_Call(ctx, "msismember", "cc", "s1", "e");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+
+  /* Deleted sets lose their filters. */
+  r = RedisModule_Call(ctx, "DEL", "c", "s1");
+  r = RedisModule_Call(ctx, "sbloom.stats", "c", "s1");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "sbloom.enable", "cc", "s1", "1");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "sbloom.enable", "cc", "s1", "0.01");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testSInterCardX(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "SADD", "cccccc", "s1", "a", "b", "c", "d", "e");
+  r = RedisModule_Call(ctx, "SADD", "ccccc", "s2", "b", "c", "d", "x");
+  r = RedisModule_Call(ctx, "SADD", "cccc", "s3", "c", "d", "b");
+  r = RedisModule_Call(ctx, "sintercardx", "cccc", "3", "s1", "s2", "s3");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "sintercardx", "cccccc", "3", "s1", "s2", "s3",
+                       "LIMIT", "2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "sintercardx", "ccc", "2", "s1", "s1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 5);
+  r = RedisModule_Call(ctx, "sintercardx", "ccc", "2", "s1", "s4");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "sintercardx", "cccc", "2", "s1", "s2", "LIMIT");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "SET", "cc", "foo", "bar");
+  r = RedisModule_Call(ctx, "sintercardx", "ccc", "2", "s4", "foo");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testRSet(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "rset.add", "ccccc", "r1", "1", "70000", "1",
+                       "4294967295");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "rset.add", "cc", "r1", "-1");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "rset.ismember", "cc", "r1", "70000");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "rset.ismember", "cc", "r1", "2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "rset.card", "c", "r1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+
+  r = RedisModule_Call(ctx, "SADD", "cccc", "s1", "1", "2", "70000");
+  r = RedisModule_Call(ctx, "rset.import", "cc", "r2", "s1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "rset.and", "ccc", "r3", "r1", "r2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "rset.or", "ccc", "r3", "r1", "r2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 4);
+  r = RedisModule_Call(ctx, "rset.andnot", "ccc", "r3", "r1", "r2");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "rset.ismember", "cc", "r3", "4294967295");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  r = RedisModule_Call(ctx, "rset.and", "ccc", "r3", "r1", "nokey");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "EXISTS", "c", "r3");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+
+  r = RedisModule_Call(ctx, "SADD", "cc", "s1", "foo");
+  r = RedisModule_Call(ctx, "rset.import", "cc", "r2", "s1");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "rset.card", "c", "s1");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testSSig(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "SADD", "cccc", "s1", "a", "b", "c");
+  r = RedisModule_Call(ctx, "SADD", "cccc", "s2", "a", "b", "c");
+  r = RedisModule_Call(ctx, "SADD", "ccc", "s3", "x", "y");
+  r = RedisModule_Call(ctx, "ssig.build", "cc", "s1", "128");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "ssig.build", "cc", "s2", "128");
+  r = RedisModule_Call(ctx, "ssig.build", "cc", "s3", "128");
+  r = RedisModule_Call(ctx, "ssim", "cc", "s1", "s2");
+  RMUtil_AssertReplyEquals(r, "1");
+  r = RedisModule_Call(ctx, "ssim", "cc", "s1", "s3");
+  RMUtil_AssertReplyEquals(r, "0");
+  r = RedisModule_Call(ctx, "ssim", "cc", "s1", "s4");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "ssig.build", "cc", "s4", "128");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+  /* Plain additions make the signature stale until it is built again, and
+   * SBLOOM.SADD keeps it current. */
+  r = RedisModule_Call(ctx, "SADD", "cc", "s1", "d");
+  r = RedisModule_Call(ctx, "sbloom.sadd", "cc", "s2", "d");
+  r = RedisModule_Call(ctx, "ssim", "cc", "s1", "s2");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+  r = RedisModule_Call(ctx, "stopsimilar", "cccc", "1", "s2", "s3", "s1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "s3");
+  r = RedisModule_Call(ctx, "ssig.build", "cc", "s1", "128");
+  r = RedisModule_Call(ctx, "ssim", "cc", "s1", "s2");
+  RMUtil_AssertReplyEquals(r, "1");
+
+  r = RedisModule_Call(ctx, "stopsimilar", "ccccc", "1", "s1", "s3", "s4",
+                       "s2");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "s2");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "1");
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testSAddCapped(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "saddcapped", "ccccc", "s1", "3", "a", "b", "c");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "saddcapped", "cccccc", "s1", "3", "RANDOM", "c",
+                       "d", "e");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "SCARD", "c", "s1");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "saddcapped", "ccc", "s1", "0", "a");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
+
+  if (set_companions) {
+    r = RedisModule_Call(ctx, "saddcapped", "cccccc", "s2", "3", "OLDEST", "a",
+                         "b", "c");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+    r = RedisModule_Call(ctx, "saddcapped", "ccccc", "s2", "3", "OLDEST", "a");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+    r = RedisModule_Call(ctx, "saddcapped", "cccccc", "s2", "3", "OLDEST", "d",
+                         "e");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+    r = RedisModule_Call(ctx, "SMISMEMBER", "cccccc", "s2", "a", "b", "c",
+                         "d", "e");
+    if (RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ARRAY) {
+      RMUtil_Assert(RedisModule_CallReplyInteger(
+                        RedisModule_CallReplyArrayElement(r, 0)) == 0);
+      RMUtil_Assert(RedisModule_CallReplyInteger(
+                        RedisModule_CallReplyArrayElement(r, 1)) == 0);
+      RMUtil_Assert(RedisModule_CallReplyInteger(
+                        RedisModule_CallReplyArrayElement(r, 2)) == 1);
+    }
+
+    /* Removed members are skipped when evicting. */
+    r = RedisModule_Call(ctx, "SREM", "cc", "s2", "c");
+    r = RedisModule_Call(ctx, "saddcapped", "ccccccc", "s2", "3", "OLDEST",
+                         "f", "g", "h");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+    r = RedisModule_Call(ctx, "SISMEMBER", "cc", "s2", "f");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+    r = RedisModule_Call(ctx, "SISMEMBER", "cc", "s2", "e");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+
+    /* Members added again after being removed are evicted by their newest
+     * records, and so are members given more than once. */
+    r = RedisModule_Call(ctx, "saddcapped", "cccc", "s3", "2", "OLDEST", "a");
+    r = RedisModule_Call(ctx, "saddcapped", "cccc", "s3", "2", "OLDEST", "b");
+    r = RedisModule_Call(ctx, "SREM", "cc", "s3", "a");
+    r = RedisModule_Call(ctx, "saddcapped", "ccccc", "s3", "2", "OLDEST", "a",
+                         "a");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+    r = RedisModule_Call(ctx, "saddcapped", "cccc", "s3", "2", "OLDEST", "c");
+    r = RedisModule_Call(ctx, "SISMEMBER", "cc", "s3", "a");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+    r = RedisModule_Call(ctx, "SISMEMBER", "cc", "s3", "b");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+    r = RedisModule_Call(ctx, "saddcapped", "cccccc", "s3", "2", "OLDEST", "d",
+                         "e", "d");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+    r = RedisModule_Call(ctx, "SISMEMBER", "cc", "s3", "e");
+    RMUtil_Assert(RedisModule_CallReplyInteger(r) == 1);
+  }
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
 int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   RedisModule_AutoMemory(ctx);
 
@@ -100,6 +1839,12 @@ int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   }
 
   RMUtil_Test(testMSIsMember);
+  RMUtil_Test(testMSIsMemberX);
+  RMUtil_Test(testSInterCardX);
+  RMUtil_Test(testSAddCapped);
+  if (set_companions) RMUtil_Test(testSBloom);
+  if (set_companions) RMUtil_Test(testSSig);
+  if (RSetType) RMUtil_Test(testRSet);
 
   RedisModule_ReplyWithSimpleString(ctx, "PASS");
   return REDISMODULE_OK;
@@ -114,6 +1859,104 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                 "readonly fast getkeys-api", 0, 0,
                                 0) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "msismemberx", MSIsMemberXCommand,
+                                "readonly getkeys-api", 0, 0,
+                                0) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "sintercardx", SInterCardXCommand,
+                                "readonly getkeys-api", 0, 0,
+                                0) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "saddcapped", SAddCappedCommand,
+                                "write deny-oom", 1, 1,
+                                1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  /* Bloom filters, signatures and insertion orders are kept current by
+   * keyspace notifications and server events, which older servers don't
+   * provide. */
+  if (RedisModule_SubscribeToKeyspaceEvents &&
+      RedisModule_SubscribeToServerEvent) {
+    set_companions = NewHashMap(8);
+    if (RedisModule_SubscribeToKeyspaceEvents(
+            ctx, REDISMODULE_NOTIFY_GENERIC | REDISMODULE_NOTIFY_SET |
+                     REDISMODULE_NOTIFY_EXPIRED | REDISMODULE_NOTIFY_EVICTED,
+            SetCompanionNotify) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_FlushDB,
+                                           SetCompanionServerEvent) ==
+            REDISMODULE_ERR ||
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_SwapDB,
+                                           SetCompanionServerEvent) ==
+            REDISMODULE_ERR ||
+        RedisModule_SubscribeToServerEvent(ctx, RedisModuleEvent_Loading,
+                                           SetCompanionServerEvent) ==
+            REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "sbloom.enable", SBloomEnableCommand,
+                                  "readonly", 1, 1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "sbloom.disable", SBloomDisableCommand,
+                                  "readonly fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "sbloom.sadd", SBloomSAddCommand,
+                                  "write deny-oom fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "sbloom.stats", SBloomStatsCommand,
+                                  "readonly fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "ssig.build", SSigBuildCommand,
+                                  "readonly", 1, 1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "ssim", SSimCommand, "readonly", 1, 2,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "stopsimilar", STopSimilarCommand,
+                                  "readonly", 2, -1, 1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+  }
+  if (RedisModule_CreateDataType) {
+    RedisModuleTypeMethods tm = {.version = REDISMODULE_TYPE_METHOD_VERSION,
+                                 .rdb_load = RSetRdbLoad,
+                                 .rdb_save = RSetRdbSave,
+                                 .aof_rewrite = RSetAofRewrite,
+                                 .mem_usage = RSetMemUsage,
+                                 .free = RSetFree};
+    RSetType = RedisModule_CreateDataType(ctx, "rxroaring",
+                                          RSET_ENCODING_VERSION, &tm);
+    if (RSetType == NULL) return REDISMODULE_ERR;
+
+    if (RedisModule_CreateCommand(ctx, "rset.add", RSetAddCommand,
+                                  "write deny-oom fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "rset.ismember", RSetIsMemberCommand,
+                                  "readonly fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "rset.card", RSetCardCommand,
+                                  "readonly fast", 1, 1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "rset.and", RSetOpGenericCommand,
+                                  "write deny-oom", 1, -1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "rset.or", RSetOpGenericCommand,
+                                  "write deny-oom", 1, -1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "rset.andnot", RSetOpGenericCommand,
+                                  "write deny-oom", 1, -1,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+    if (RedisModule_CreateCommand(ctx, "rset.import", RSetImportCommand,
+                                  "write deny-oom", 1, 2,
+                                  1) == REDISMODULE_ERR)
+      return REDISMODULE_ERR;
+  }
   if (RedisModule_CreateCommand(ctx, "rxsets.test", TestModule, "write", 0, 0,
                                 0) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
@@ -18,6 +18,11 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "../redismodule.h"
 #include "../rmutil/util.h"
@@ -186,6 +191,979 @@ int PrependCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   return REDISMODULE_OK;
 }
 
+/* Compressed values are stored with a small header: a 6 byte magic, a
+ * method byte, a zero byte, the raw length and a check word, the last two as
+ * little endian 32 bit integers. The check word covers the header and the
+ * stored length, so that plain Strings are very unlikely to pass for
+ * compressed ones. */
+#define RXZ_MAGIC "\x89RXZ\r\n"
+#define RXZ_MAGICLEN 6
+#define RXZ_HDRLEN 16
+#define RXZ_STORED 0
+#define RXZ_LZF 1
+#define RXZ_DEFAULT_LEVEL 6
+#define RXZ_MAX_OFF 8192
+#define RXZ_MAX_REF 264
+#define RXZ_MAX_LIT 32
+
+/* Module-wide codec statistics, reported by STRZINFO. */
+static unsigned long long rxz_compress_usec = 0;
+static unsigned long long rxz_decompress_usec = 0;
+static unsigned long long rxz_compress_bytes = 0;
+static unsigned long long rxz_decompress_bytes = 0;
+
+/* Helper function: returns the thread's CPU time in microseconds. */
+unsigned long long rxz_cputime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Helper function: LZF compatible compressor. 'level' (1-9) sets the size of
+ * the match finder's hash table. Returns the compressed length, or 0 if the
+ * output doesn't fit in 'outlen' bytes. */
+size_t rxz_compress(const unsigned char *in, size_t inlen, unsigned char *out,
+                    size_t outlen, int level) {
+  /* The table needn't have many more slots than the input has positions. */
+  int hlog = 8 + level;
+  while (hlog > 4 && ((size_t)1 << (hlog - 1)) >= inlen) hlog--;
+  uint32_t *htab = calloc((size_t)1 << hlog, sizeof(uint32_t));
+  if (htab == NULL) return 0;
+
+  const unsigned char *ip = in, *in_end = in + inlen;
+  unsigned char *op = out, *out_end = out + outlen;
+  size_t lit = 0;
+
+  /* Every literal run is preceded by a control byte, reserve it upfront. */
+  if (op >= out_end) goto overflow;
+  op++;
+
+  while (ip + 2 < in_end) {
+    uint32_t v = (ip[0] << 16) | (ip[1] << 8) | ip[2];
+    uint32_t h = (v * 2654435761u) >> (32 - hlog);
+    const unsigned char *ref = in + htab[h];
+    htab[h] = ip - in;
+
+    size_t off = ip - ref - 1;
+    if (ref < ip && off < RXZ_MAX_OFF && ref[0] == ip[0] && ref[1] == ip[1] &&
+        ref[2] == ip[2]) {
+      size_t maxlen = in_end - ip;
+      if (maxlen > RXZ_MAX_REF) maxlen = RXZ_MAX_REF;
+      size_t len = 3;
+      while (len < maxlen && ref[len] == ip[len]) len++;
+
+      /* Close the pending literal run, or drop its unused control byte. */
+      if (lit)
+        op[-lit - 1] = lit - 1;
+      else
+        op--;
+      if (op + 4 > out_end) goto overflow;
+
+      size_t elen = len - 2;
+      if (elen < 7) {
+        *op++ = (off >> 8) + (elen << 5);
+      } else {
+        *op++ = (off >> 8) + (7 << 5);
+        *op++ = elen - 7;
+      }
+      *op++ = off;
+
+      lit = 0;
+      op++;
+      ip += len;
+      continue;
+    }
+
+    if (op >= out_end) goto overflow;
+    *op++ = *ip++;
+    if (++lit == RXZ_MAX_LIT) {
+      op[-lit - 1] = lit - 1;
+      lit = 0;
+      if (op >= out_end) goto overflow;
+      op++;
+    }
+  }
+
+  while (ip < in_end) {
+    if (op >= out_end) goto overflow;
+    *op++ = *ip++;
+    if (++lit == RXZ_MAX_LIT) {
+      op[-lit - 1] = lit - 1;
+      lit = 0;
+      if (op >= out_end) goto overflow;
+      op++;
+    }
+  }
+  if (lit)
+    op[-lit - 1] = lit - 1;
+  else
+    op--;
+
+  free(htab);
+  return op - out;
+
+overflow:
+  free(htab);
+  return 0;
+}
+
+/* Helper function: LZF decompressor. Returns the decompressed length, or 0
+ * if the input is corrupt or doesn't decompress to exactly 'outlen' bytes. */
+size_t rxz_decompress(const unsigned char *in, size_t inlen, unsigned char *out,
+                      size_t outlen) {
+  const unsigned char *ip = in, *in_end = in + inlen;
+  unsigned char *op = out, *out_end = out + outlen;
+
+  while (ip < in_end) {
+    size_t ctrl = *ip++;
+    if (ctrl < RXZ_MAX_LIT) {
+      ctrl++;
+      if (op + ctrl > out_end || ip + ctrl > in_end) return 0;
+      memcpy(op, ip, ctrl);
+      op += ctrl;
+      ip += ctrl;
+    } else {
+      size_t len = ctrl >> 5;
+      if (ip >= in_end) return 0;
+      if (len == 7) {
+        len += *ip++;
+        if (ip >= in_end) return 0;
+      }
+      len += 2;
+      size_t off = ((ctrl & 0x1f) << 8) + *ip++ + 1;
+      if (off > (size_t)(op - out) || op + len > out_end) return 0;
+      const unsigned char *ref = op - off;
+      while (len--) *op++ = *ref++;
+    }
+  }
+
+  return (op == out_end ? outlen : 0);
+}
+
+/* Helper function: reads a little endian 32 bit integer. */
+uint32_t rxz_get32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+/* Helper function: writes a little endian 32 bit integer. */
+void rxz_put32(unsigned char *p, uint32_t v) {
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+/* Helper function: FNV-1a of a header's first 12 bytes and of the stored
+ * value's length 'len'. */
+uint32_t rxz_check(const unsigned char *hdr, size_t len) {
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < 12; i++) h = (h ^ hdr[i]) * 16777619u;
+  for (int i = 0; i < 8; i++) h = (h ^ ((len >> (i * 8)) & 0xff)) * 16777619u;
+  return h;
+}
+
+/* Helper function: parses a compressed value's header. Returns 1 if 'val'
+ * carries one, 0 for plain Strings. */
+int rxz_header(const char *val, size_t len, int *method, size_t *rawlen) {
+  const unsigned char *p = (const unsigned char *)val;
+  if (len < RXZ_HDRLEN || memcmp(p, RXZ_MAGIC, RXZ_MAGICLEN) ||
+      (p[6] != RXZ_STORED && p[6] != RXZ_LZF) || p[7] ||
+      rxz_get32(p + 12) != rxz_check(p, len))
+    return 0;
+
+  *method = p[6];
+  *rawlen = rxz_get32(p + 8);
+  return 1;
+}
+
+/* Helper function: returns a newly allocated copy of a value's raw bytes with
+ * 'extra' bytes of spare room at its end, or NULL on corruption. */
+char *rxz_load(const char *val, size_t len, size_t extra, size_t *rawlen) {
+  int method;
+  char *raw;
+
+  if (!rxz_header(val, len, &method, rawlen)) {
+    *rawlen = len;
+    if ((raw = malloc(len + extra + 1)) == NULL) return NULL;
+    memcpy(raw, val, len);
+    return raw;
+  }
+
+  if ((raw = malloc(*rawlen + extra + 1)) == NULL) return NULL;
+  if (method == RXZ_STORED) {
+    if (len - RXZ_HDRLEN != *rawlen) goto corrupt;
+    memcpy(raw, val + RXZ_HDRLEN, *rawlen);
+  } else {
+    unsigned long long start = rxz_cputime();
+    if (rxz_decompress((const unsigned char *)val + RXZ_HDRLEN,
+                       len - RXZ_HDRLEN, (unsigned char *)raw,
+                       *rawlen) != *rawlen)
+      goto corrupt;
+    rxz_decompress_usec += rxz_cputime() - start;
+    rxz_decompress_bytes += *rawlen;
+  }
+  return raw;
+
+corrupt:
+  free(raw);
+  return NULL;
+}
+
+/* Helper function: compresses 'raw' and stores it in the String 'key' using
+ * direct memory access. A 'level' of 0 stores the value uncompressed. */
+int rxz_store(RedisModuleKey *key, const char *raw, size_t rawlen, int level) {
+  size_t bound = RXZ_HDRLEN + rawlen;
+  unsigned char *buf = malloc(bound);
+  if (buf == NULL) return REDISMODULE_ERR;
+
+  size_t clen = 0;
+  if (level > 0 && rawlen > RXZ_HDRLEN) {
+    unsigned long long start = rxz_cputime();
+    clen = rxz_compress((const unsigned char *)raw, rawlen, buf + RXZ_HDRLEN,
+                        rawlen - 1, level);
+    rxz_compress_usec += rxz_cputime() - start;
+    rxz_compress_bytes += rawlen;
+  }
+
+  /* Fallback to storing the value as is when it doesn't compress. */
+  memcpy(buf, RXZ_MAGIC, RXZ_MAGICLEN);
+  if (clen) {
+    buf[6] = RXZ_LZF;
+  } else {
+    buf[6] = RXZ_STORED;
+    memcpy(buf + RXZ_HDRLEN, raw, rawlen);
+    clen = rawlen;
+  }
+  buf[7] = 0;
+  rxz_put32(buf + 8, rawlen);
+  size_t len = RXZ_HDRLEN + clen;
+  rxz_put32(buf + 12, rxz_check(buf, len));
+
+  if (RedisModule_StringTruncate(key, len) != REDISMODULE_OK) {
+    free(buf);
+    return REDISMODULE_ERR;
+  }
+  size_t dmalen;
+  char *val = RedisModule_StringDMA(key, &dmalen, REDISMODULE_WRITE);
+  memcpy(val, buf, len);
+  free(buf);
+
+  return REDISMODULE_OK;
+}
+
+/* Helper function: parses the optional LEVEL argument of SETZ and APPENDZ. */
+int rxz_level(RedisModuleCtx *ctx, RedisModuleString **argv, int argc,
+              long long *level) {
+  *level = RXZ_DEFAULT_LEVEL;
+  if (argc == 3) return REDISMODULE_OK;
+
+  const char *subcmd = RedisModule_StringPtrLen(argv[3], NULL);
+  if (strcasecmp("level", subcmd) ||
+      RedisModule_StringToLongLong(argv[4], level) != REDISMODULE_OK ||
+      *level < 0 || *level > 9) {
+    RedisModule_ReplyWithError(ctx, "ERR invalid level - must be 0 to 9");
+    return REDISMODULE_ERR;
+  }
+  return REDISMODULE_OK;
+}
+
+/*
+* SETZ key value [LEVEL n]
+* Sets a String key to a compressed value. The optional 'LEVEL' (0-9,
+* default 6) trades CPU for compression ratio, 0 stores the value as is.
+* Like SET, any previous value and time to live are discarded.
+* Reply: String, "OK".
+*/
+int SetZCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 3 && argc != 5) return RedisModule_WrongArity(ctx);
+
+  RedisModule_AutoMemory(ctx);
+
+  long long level;
+  if (rxz_level(ctx, argv, argc, &level) != REDISMODULE_OK)
+    return REDISMODULE_ERR;
+
+  size_t rawlen;
+  const char *raw = RedisModule_StringPtrLen(argv[2], &rawlen);
+  if (rawlen > UINT32_MAX) {
+    RedisModule_ReplyWithError(ctx, "ERR value is too large");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING)
+      RedisModule_DeleteKey(key);
+    else
+      RedisModule_SetExpire(key, REDISMODULE_NO_EXPIRE);
+  }
+
+  if (rxz_store(key, raw, rawlen, level) != REDISMODULE_OK) {
+    RedisModule_ReplyWithError(ctx, "ERR could not store value");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModule_ReplyWithSimpleString(ctx, "OK");
+  return REDISMODULE_OK;
+}
+
+/*
+* GETZ key
+* Gets the value of a String key set with SETZ or APPENDZ, decompressing it.
+* Plain Strings are returned as is.
+* Reply: String, the value or NULL if 'key' doesn't exist.
+*/
+int GetZCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModule_ReplyWithNull(ctx);
+    return REDISMODULE_OK;
+  }
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  size_t len, rawlen;
+  int method;
+  const char *val = RedisModule_StringDMA(key, &len, REDISMODULE_READ);
+
+  /* Plain and stored values are replied to directly from the key. */
+  if (!rxz_header(val, len, &method, &rawlen)) {
+    RedisModule_ReplyWithStringBuffer(ctx, val, len);
+    return REDISMODULE_OK;
+  }
+  if (method == RXZ_STORED && len - RXZ_HDRLEN == rawlen) {
+    RedisModule_ReplyWithStringBuffer(ctx, val + RXZ_HDRLEN, rawlen);
+    return REDISMODULE_OK;
+  }
+
+  char *raw = rxz_load(val, len, 0, &rawlen);
+  if (raw == NULL) {
+    RedisModule_ReplyWithError(ctx, "ERR compressed value is corrupt");
+    return REDISMODULE_ERR;
+  }
+  RedisModule_ReplyWithStringBuffer(ctx, raw, rawlen);
+  free(raw);
+
+  return REDISMODULE_OK;
+}
+
+/*
+* APPENDZ key value [LEVEL n]
+* Appends a value to a compressed String key, recompressing it. If 'key' does
+* not exist APPENDZ is similar to SETZ.
+* Reply: Integer, the uncompressed length of the String after the append.
+*/
+int AppendZCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 3 && argc != 5) return RedisModule_WrongArity(ctx);
+
+  RedisModule_AutoMemory(ctx);
+
+  long long level;
+  if (rxz_level(ctx, argv, argc, &level) != REDISMODULE_OK)
+    return REDISMODULE_ERR;
+
+  RedisModuleKey *key =
+      RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY &&
+      RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  size_t arglen, len, rawlen = 0;
+  const char *arg = RedisModule_StringPtrLen(argv[2], &arglen);
+  const char *val = "";
+  len = 0;
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_STRING)
+    val = RedisModule_StringDMA(key, &len, REDISMODULE_READ);
+
+  char *raw = rxz_load(val, len, arglen, &rawlen);
+  if (raw == NULL) {
+    RedisModule_ReplyWithError(ctx, "ERR compressed value is corrupt");
+    return REDISMODULE_ERR;
+  }
+  if (rawlen + arglen > UINT32_MAX) {
+    free(raw);
+    RedisModule_ReplyWithError(ctx, "ERR value is too large");
+    return REDISMODULE_ERR;
+  }
+  memcpy(raw + rawlen, arg, arglen);
+  rawlen += arglen;
+
+  int status = rxz_store(key, raw, rawlen, level);
+  free(raw);
+  if (status != REDISMODULE_OK) {
+    RedisModule_ReplyWithError(ctx, "ERR could not store value");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, rawlen);
+  return REDISMODULE_OK;
+}
+
+/*
+* STRZINFO key
+* Reports a String key's compression details along with the module's
+* cumulative codec CPU time and throughput.
+* Reply: Array, field names and values, or NULL if 'key' doesn't exist.
+*/
+int StrZInfoCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 2) return RedisModule_WrongArity(ctx);
+
+  RedisModule_AutoMemory(ctx);
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModule_ReplyWithNull(ctx);
+    return REDISMODULE_OK;
+  }
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  size_t len, rawlen;
+  int method;
+  const char *encoding = "raw";
+  const char *val = RedisModule_StringDMA(key, &len, REDISMODULE_READ);
+  if (rxz_header(val, len, &method, &rawlen))
+    encoding = (method == RXZ_LZF ? "lzf" : "stored");
+  else
+    rawlen = len;
+
+  RedisModule_ReplyWithArray(ctx, 16);
+  RedisModule_ReplyWithSimpleString(ctx, "encoding");
+  RedisModule_ReplyWithSimpleString(ctx, encoding);
+  RedisModule_ReplyWithSimpleString(ctx, "length");
+  RedisModule_ReplyWithLongLong(ctx, rawlen);
+  RedisModule_ReplyWithSimpleString(ctx, "stored_length");
+  RedisModule_ReplyWithLongLong(ctx, len);
+  RedisModule_ReplyWithSimpleString(ctx, "ratio");
+  RedisModule_ReplyWithDouble(ctx, len ? (double)rawlen / len : 1);
+  RedisModule_ReplyWithSimpleString(ctx, "compress_usec");
+  RedisModule_ReplyWithLongLong(ctx, rxz_compress_usec);
+  RedisModule_ReplyWithSimpleString(ctx, "compress_bytes");
+  RedisModule_ReplyWithLongLong(ctx, rxz_compress_bytes);
+  RedisModule_ReplyWithSimpleString(ctx, "decompress_usec");
+  RedisModule_ReplyWithLongLong(ctx, rxz_decompress_usec);
+  RedisModule_ReplyWithSimpleString(ctx, "decompress_bytes");
+  RedisModule_ReplyWithLongLong(ctx, rxz_decompress_bytes);
+
+  return REDISMODULE_OK;
+}
+
+/* Hash algorithms supported by STRHASH and MSTRHASH. */
+enum StrHashAlgo { STRHASH_XXH64, STRHASH_CRC32C, STRHASH_SHA1 };
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t xxh_read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH_PRIME64_2;
+  acc = xxh_rotl64(acc, 31);
+  return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+  acc ^= xxh64_round(0, val);
+  return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/* Helper function: XXH64 with a zero seed. The four independent lanes keep
+ * the CPU's pipelines busy over large buffers. Assumes a little endian host,
+ * like the rest of Redis' DMA users. */
+uint64_t strhash_xxh64(const unsigned char *p, size_t len) {
+  const unsigned char *end = p + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    const unsigned char *limit = end - 32;
+    uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+    uint64_t v2 = XXH_PRIME64_2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -XXH_PRIME64_1;
+    do {
+      v1 = xxh64_round(v1, xxh_read64(p));
+      v2 = xxh64_round(v2, xxh_read64(p + 8));
+      v3 = xxh64_round(v3, xxh_read64(p + 16));
+      v4 = xxh64_round(v4, xxh_read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) +
+        xxh_rotl64(v4, 18);
+    h = xxh64_merge(h, v1);
+    h = xxh64_merge(h, v2);
+    h = xxh64_merge(h, v3);
+    h = xxh64_merge(h, v4);
+  } else {
+    h = XXH_PRIME64_5;
+  }
+  h += (uint64_t)len;
+
+  while (p + 8 <= end) {
+    h ^= xxh64_round(0, xxh_read64(p));
+    h = xxh_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+    h = xxh_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= (*p++) * XXH_PRIME64_5;
+    h = xxh_rotl64(h, 11) * XXH_PRIME64_1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+/* CRC32C (Castagnoli) slicing-by-8 tables, built on first use. */
+static uint32_t crc32c_table[8][256];
+static int crc32c_ready = 0;
+
+void crc32c_init(void) {
+  int i, j;
+  for (i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (j = 0; j < 8; j++) c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+    crc32c_table[0][i] = c;
+  }
+  for (i = 0; i < 256; i++) {
+    uint32_t c = crc32c_table[0][i];
+    for (j = 1; j < 8; j++) {
+      c = crc32c_table[0][c & 0xff] ^ (c >> 8);
+      crc32c_table[j][i] = c;
+    }
+  }
+  crc32c_ready = 1;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len) {
+  if (!crc32c_ready) crc32c_init();
+  while (len >= 8) {
+    uint32_t lo = xxh_read32(p) ^ crc, hi = xxh_read32(p + 4);
+    crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+          crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+          crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^
+          crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+  while (len--) crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/* SSE4.2 has a CRC32C instruction, used when the CPU supports it. */
+__attribute__((target("sse4.2"))) uint32_t crc32c_hw(uint32_t crc,
+                                                     const unsigned char *p,
+                                                     size_t len) {
+  uint64_t c = crc;
+  while (len >= 8) {
+    c = __builtin_ia32_crc32di(c, xxh_read64(p));
+    p += 8;
+    len -= 8;
+  }
+  crc = (uint32_t)c;
+  while (len--) crc = __builtin_ia32_crc32qi(crc, *p++);
+  return crc;
+}
+#endif
+
+/* Helper function: CRC32C, hardware accelerated where available. */
+uint32_t strhash_crc32c(const unsigned char *p, size_t len) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (__builtin_cpu_supports("sse4.2")) return ~crc32c_hw(~0U, p, len);
+#endif
+  return ~crc32c_sw(~0U, p, len);
+}
+
+#define SHA1_ROL(v, b) (((v) << (b)) | ((v) >> (32 - (b))))
+
+void sha1_block(uint32_t state[5], const unsigned char *p) {
+  uint32_t w[80], a, b, c, d, e, t;
+  int i;
+
+  for (i = 0; i < 16; i++)
+    w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) |
+           ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+  for (i = 16; i < 80; i++)
+    w[i] = SHA1_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  for (i = 0; i < 80; i++) {
+    if (i < 20)
+      t = ((b & c) | (~b & d)) + 0x5A827999;
+    else if (i < 40)
+      t = (b ^ c ^ d) + 0x6ED9EBA1;
+    else if (i < 60)
+      t = ((b & c) | (b & d) | (c & d)) + 0x8F1BBCDC;
+    else
+      t = (b ^ c ^ d) + 0xCA62C1D6;
+    t += SHA1_ROL(a, 5) + e + w[i];
+    e = d;
+    d = c;
+    c = SHA1_ROL(b, 30);
+    b = a;
+    a = t;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+/* Helper function: SHA1 digest of a buffer. */
+void strhash_sha1(const unsigned char *p, size_t len, unsigned char *digest) {
+  uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                       0xC3D2E1F0};
+  unsigned char tail[128];
+  size_t i, rem = len % 64, tlen = (rem < 56 ? 64 : 128);
+  uint64_t bits = (uint64_t)len * 8;
+
+  for (i = 0; i + 64 <= len; i += 64) sha1_block(state, p + i);
+
+  memset(tail, 0, tlen);
+  memcpy(tail, p + i, rem);
+  tail[rem] = 0x80;
+  for (i = 0; i < 8; i++) tail[tlen - 1 - i] = (bits >> (8 * i)) & 0xff;
+  sha1_block(state, tail);
+  if (tlen == 128) sha1_block(state, tail + 64);
+
+  for (i = 0; i < 20; i++) digest[i] = (state[i / 4] >> (24 - 8 * (i % 4))) & 0xff;
+}
+
+/* Helper function: parses a hash algorithm name. */
+int strhash_algo(RedisModuleString *arg, int *algo) {
+  const char *name = RedisModule_StringPtrLen(arg, NULL);
+  if (!strcasecmp("xxh64", name))
+    *algo = STRHASH_XXH64;
+  else if (!strcasecmp("crc32c", name))
+    *algo = STRHASH_CRC32C;
+  else if (!strcasecmp("sha1", name))
+    *algo = STRHASH_SHA1;
+  else
+    return REDISMODULE_ERR;
+  return REDISMODULE_OK;
+}
+
+/* Helper function: replies with a buffer's hash as a hex String. */
+void strhash_reply(RedisModuleCtx *ctx, int algo, const char *buf,
+                   size_t len) {
+  static const char *hexdigits = "0123456789abcdef";
+  const unsigned char *p = (const unsigned char *)buf;
+  unsigned char digest[20];
+  char hex[40];
+  size_t i, dlen;
+
+  switch (algo) {
+    case STRHASH_CRC32C: {
+      uint32_t crc = strhash_crc32c(p, len);
+      for (i = 0; i < 4; i++) digest[i] = (crc >> (24 - 8 * i)) & 0xff;
+      dlen = 4;
+      break;
+    }
+    case STRHASH_SHA1:
+      strhash_sha1(p, len, digest);
+      dlen = 20;
+      break;
+    default: {
+      uint64_t h = strhash_xxh64(p, len);
+      for (i = 0; i < 8; i++) digest[i] = (h >> (56 - 8 * i)) & 0xff;
+      dlen = 8;
+      break;
+    }
+  }
+
+  for (i = 0; i < dlen; i++) {
+    hex[2 * i] = hexdigits[digest[i] >> 4];
+    hex[2 * i + 1] = hexdigits[digest[i] & 0xf];
+  }
+  RedisModule_ReplyWithStringBuffer(ctx, hex, 2 * dlen);
+}
+
+/*
+* STRHASH key [XXH64|CRC32C|SHA1] [RANGE start end]
+* Hashes a String's value in place. The default algorithm is XXH64. The
+* optional 'RANGE' limits hashing to a substring, with offsets as in GETRANGE.
+* Reply: String, the hex digest or NULL if 'key' doesn't exist.
+*/
+int StrHashCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 2 || argc > 6) return RedisModule_WrongArity(ctx);
+
+  RedisModule_AutoMemory(ctx);
+
+  /* Parse the optional algorithm and range. */
+  int algo = STRHASH_XXH64, i = 2;
+  long long start = 0, end = -1;
+  if (i < argc &&
+      strcasecmp("range", RedisModule_StringPtrLen(argv[i], NULL))) {
+    if (strhash_algo(argv[i], &algo) != REDISMODULE_OK) {
+      RedisModule_ReplyWithError(ctx, "ERR unknown hash algorithm");
+      return REDISMODULE_ERR;
+    }
+    i++;
+  }
+  if (i < argc) {
+    if (argc - i != 3 ||
+        strcasecmp("range", RedisModule_StringPtrLen(argv[i], NULL))) {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
+    }
+    if (RedisModule_StringToLongLong(argv[i + 1], &start) != REDISMODULE_OK ||
+        RedisModule_StringToLongLong(argv[i + 2], &end) != REDISMODULE_OK) {
+      RedisModule_ReplyWithError(ctx, "ERR invalid range");
+      return REDISMODULE_ERR;
+    }
+  }
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModule_ReplyWithNull(ctx);
+    return REDISMODULE_OK;
+  }
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  size_t len;
+  const char *val = RedisModule_StringDMA(key, &len, REDISMODULE_READ);
+
+  /* Clamp the range the way GETRANGE does. */
+  if (start < 0) start += len;
+  if (end < 0) end += len;
+  if (start < 0) start = 0;
+  if (end >= (long long)len) end = len - 1;
+  if (start > end || len == 0)
+    strhash_reply(ctx, algo, val, 0);
+  else
+    strhash_reply(ctx, algo, val + start, end - start + 1);
+
+  return REDISMODULE_OK;
+}
+
+/*
+* MSTRHASH algo key [key ...]
+* Hashes the values of multiple Strings in place.
+* Reply: Array of Strings, the hex digests, with NULL for keys that don't
+* exist or aren't Strings (like MGET).
+*/
+int MStrHashCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 3) return RedisModule_WrongArity(ctx);
+
+  RedisModule_AutoMemory(ctx);
+
+  int algo;
+  if (strhash_algo(argv[1], &algo) != REDISMODULE_OK) {
+    RedisModule_ReplyWithError(ctx, "ERR unknown hash algorithm");
+    return REDISMODULE_ERR;
+  }
+
+  int i;
+  RedisModule_ReplyWithArray(ctx, argc - 2);
+  for (i = 2; i < argc; i++) {
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING) {
+      RedisModule_ReplyWithNull(ctx);
+    } else {
+      size_t len;
+      const char *val = RedisModule_StringDMA(key, &len, REDISMODULE_READ);
+      strhash_reply(ctx, algo, val, len);
+    }
+    RedisModule_CloseKey(key);
+  }
+
+  return REDISMODULE_OK;
+}
+
+/* Helper function: finds the first occurrence of 'needle' in 'hay'. Candidate
+ * positions are filtered 16 at a time by comparing the needle's first and
+ * last bytes with SSE2, and only then verified with memcmp. */
+const char *strfind_memmem(const char *hay, size_t hlen, const char *needle,
+                           size_t nlen) {
+  if (nlen > hlen) return NULL;
+  if (nlen == 1) return memchr(hay, needle[0], hlen);
+
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[nlen - 1]);
+  for (; i + nlen - 1 + 16 <= hlen; i += 16) {
+    __m128i bf = _mm_loadu_si128((const __m128i *)(hay + i));
+    __m128i bl = _mm_loadu_si128((const __m128i *)(hay + i + nlen - 1));
+    unsigned mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(first, bf), _mm_cmpeq_epi8(last, bl)));
+    while (mask) {
+      int bit = __builtin_ctz(mask);
+      if (!memcmp(hay + i + bit + 1, needle + 1, nlen - 2))
+        return hay + i + bit;
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  /* Scalar scan for the remainder (or everything, without SSE2). */
+  while (i + nlen <= hlen) {
+    const char *p = memchr(hay + i, needle[0], hlen - nlen + 1 - i);
+    if (p == NULL) return NULL;
+    if (p[nlen - 1] == needle[nlen - 1] && !memcmp(p + 1, needle + 1, nlen - 2))
+      return p;
+    i = p - hay + 1;
+  }
+  return NULL;
+}
+
+/*
+* STRFIND key needle [FROM offset] [LIMIT n]
+* Finds the non-overlapping occurrences of 'needle' in a String's value,
+* starting at 'offset' (negative offsets count from the end), returning at
+* most 'n' of them.
+* Reply: Array of Integers, the byte offsets of the occurrences.
+*/
+int StrFindCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc < 3 || argc > 7 || argc % 2 == 0)
+    return RedisModule_WrongArity(ctx);
+
+  RedisModule_AutoMemory(ctx);
+
+  size_t nlen;
+  const char *needle = RedisModule_StringPtrLen(argv[2], &nlen);
+  if (nlen == 0) {
+    RedisModule_ReplyWithError(ctx, "ERR needle must not be empty");
+    return REDISMODULE_ERR;
+  }
+
+  /* Parse subcommands. */
+  long long from = 0, limit = -1;
+  int i;
+  for (i = 3; i < argc; i += 2) {
+    const char *subcmd = RedisModule_StringPtrLen(argv[i], NULL);
+    if (!strcasecmp("from", subcmd)) {
+      if (RedisModule_StringToLongLong(argv[i + 1], &from) != REDISMODULE_OK) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid offset");
+        return REDISMODULE_ERR;
+      }
+    } else if (!strcasecmp("limit", subcmd)) {
+      if ((RedisModule_StringToLongLong(argv[i + 1], &limit) !=
+           REDISMODULE_OK) ||
+          (limit < 1)) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid limit");
+        return REDISMODULE_ERR;
+      }
+    } else {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
+    }
+  }
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY &&
+      RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  size_t len = 0;
+  const char *val = "";
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_STRING)
+    val = RedisModule_StringDMA(key, &len, REDISMODULE_READ);
+  if (from < 0) from += len;
+  if (from < 0) from = 0;
+
+  long long found = 0;
+  RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
+  while (from < (long long)len && found != limit) {
+    const char *p = strfind_memmem(val + from, len - from, needle, nlen);
+    if (p == NULL) break;
+    RedisModule_ReplyWithLongLong(ctx, p - val);
+    found++;
+    from = p - val + nlen;
+  }
+  RedisModule_ReplySetArrayLength(ctx, found);
+
+  return REDISMODULE_OK;
+}
+
+/*
+* STRCOUNT key needle
+* Counts the non-overlapping occurrences of 'needle' in a String's value.
+* Reply: Integer, the number of occurrences.
+*/
+int StrCountCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+  if (argc != 3) return RedisModule_WrongArity(ctx);
+
+  RedisModule_AutoMemory(ctx);
+
+  size_t nlen;
+  const char *needle = RedisModule_StringPtrLen(argv[2], &nlen);
+  if (nlen == 0) {
+    RedisModule_ReplyWithError(ctx, "ERR needle must not be empty");
+    return REDISMODULE_ERR;
+  }
+
+  RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+    RedisModule_ReplyWithLongLong(ctx, 0);
+    return REDISMODULE_OK;
+  }
+  if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STRING) {
+    RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    return REDISMODULE_ERR;
+  }
+
+  size_t len, from = 0;
+  const char *val = RedisModule_StringDMA(key, &len, REDISMODULE_READ);
+  long long count = 0;
+  while (from < len) {
+    const char *p = strfind_memmem(val + from, len - from, needle, nlen);
+    if (p == NULL) break;
+    count++;
+    from = p - val + nlen;
+  }
+
+  RedisModule_ReplyWithLongLong(ctx, count);
+  return REDISMODULE_OK;
+}
+
 /* Helper function for SETRANGERAND: uppercases a string in place. */
 void stoupper(char *s) {
   size_t l = strlen(s);
@@ -433,6 +1411,100 @@ int testSetRangeRand(RedisModuleCtx *ctx) {
   return 0;
 }
 
+int testSetZ(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "getz", "c", "foo");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "setz", "cc", "foo",
+                       "abcabcabcabcabcabcabcabcabcabcabcabc");
+  RMUtil_AssertReplyEquals(r, "OK");
+  r = RedisModule_Call(ctx, "strlen", "c", "foo");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) < 36);
+  r = RedisModule_Call(ctx, "getz", "c", "foo");
+  RMUtil_AssertReplyEquals(r, "abcabcabcabcabcabcabcabcabcabcabcabc");
+  r = RedisModule_Call(ctx, "appendz", "cc", "foo", "xyz");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 39);
+  r = RedisModule_Call(ctx, "getz", "c", "foo");
+  RMUtil_AssertReplyEquals(r, "abcabcabcabcabcabcabcabcabcabcabcabcxyz");
+  r = RedisModule_Call(ctx, "strzinfo", "c", "foo");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 16);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "lzf");
+  r = RedisModule_Call(ctx, "setz", "cccc", "foo", "bar", "LEVEL", "0");
+  RMUtil_AssertReplyEquals(r, "OK");
+  r = RedisModule_Call(ctx, "getz", "c", "foo");
+  RMUtil_AssertReplyEquals(r, "bar");
+  r = RedisModule_Call(ctx, "set", "cc", "foo", "plain");
+  r = RedisModule_Call(ctx, "getz", "c", "foo");
+  RMUtil_AssertReplyEquals(r, "plain");
+
+  /* Plain Strings that start like a compressed value are returned as is. */
+  const char magic[] = "\x89RXZ\r\n\x01\0\x03\0\0\0" "abcdxyz";
+  size_t len;
+  r = RedisModule_Call(ctx, "set", "cb", "foo", magic, sizeof(magic) - 1);
+  r = RedisModule_Call(ctx, "getz", "c", "foo");
+  const char *val = RedisModule_CallReplyStringPtr(r, &len);
+  RMUtil_Assert(len == sizeof(magic) - 1 && !memcmp(val, magic, len));
+  r = RedisModule_Call(ctx, "set", "cc", "foo", "RXZ\x01" "abcdxyz");
+  r = RedisModule_Call(ctx, "getz", "c", "foo");
+  RMUtil_AssertReplyEquals(r, "RXZ\x01" "abcdxyz");
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testStrHash(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "strhash", "c", "foo");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "set", "cc", "foo", "abc");
+  r = RedisModule_Call(ctx, "strhash", "c", "foo");
+  RMUtil_AssertReplyEquals(r, "44bc2cf5ad770999");
+  r = RedisModule_Call(ctx, "strhash", "cc", "foo", "sha1");
+  RMUtil_AssertReplyEquals(r, "a9993e364706816aba3e25717850c26c9cd0d89d");
+  r = RedisModule_Call(ctx, "set", "cc", "bar", "xx123456789");
+  r = RedisModule_Call(ctx, "strhash", "ccccc", "bar", "crc32c", "range", "2",
+                       "-1");
+  RMUtil_AssertReplyEquals(r, "e3069283");
+  r = RedisModule_Call(ctx, "mstrhash", "cccc", "xxh64", "foo", "baz", "foo");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0),
+                           "44bc2cf5ad770999");
+  RMUtil_Assert(RedisModule_CallReplyType(RedisModule_CallReplyArrayElement(
+                    r, 1)) == REDISMODULE_REPLY_NULL);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testStrFind(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "strcount", "cc", "log", "ERR");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 0);
+  r = RedisModule_Call(ctx, "set", "cc", "log",
+                       "ERR a\nOK b\nERR c\nOK d\nOK e ERR f\n");
+  r = RedisModule_Call(ctx, "strcount", "cc", "log", "ERR");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "strfind", "cc", "log", "ERR");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 0)) == 0);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 1)) == 11);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 2)) == 27);
+  r = RedisModule_Call(ctx, "strfind", "cccccc", "log", "ERR", "FROM", "1",
+                       "LIMIT", "1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 1);
+  RMUtil_Assert(RedisModule_CallReplyInteger(
+                    RedisModule_CallReplyArrayElement(r, 0)) == 11);
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
 int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   RedisModule_AutoMemory(ctx);
 
@@ -447,6 +1519,9 @@ int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   RMUtil_Test(testCheckAnd);
   RMUtil_Test(testPrepend);
   RMUtil_Test(testSetRangeRand);
+  RMUtil_Test(testSetZ);
+  RMUtil_Test(testStrHash);
+  RMUtil_Test(testStrFind);
 
   RedisModule_ReplyWithSimpleString(ctx, "PASS");
   return REDISMODULE_OK;
@@ -468,6 +1543,30 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
                                 "write fast deny-oom", 1, 1,
                                 1) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "setz", SetZCommand, "write deny-oom", 1,
+                                1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "getz", GetZCommand, "readonly", 1, 1,
+                                1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "appendz", AppendZCommand,
+                                "write deny-oom", 1, 1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "strzinfo", StrZInfoCommand, "readonly",
+                                1, 1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "strhash", StrHashCommand, "readonly",
+                                1, 1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "mstrhash", MStrHashCommand, "readonly",
+                                2, -1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "strfind", StrFindCommand, "readonly",
+                                1, 1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
+  if (RedisModule_CreateCommand(ctx, "strcount", StrCountCommand, "readonly",
+                                1, 1, 1) == REDISMODULE_ERR)
+    return REDISMODULE_ERR;
   if (RedisModule_CreateCommand(ctx, "rxstrings.test", TestModule, "write", 0,
                                 0, 0) == REDISMODULE_ERR)
     return REDISMODULE_ERR;
@@ -15,6 +15,8 @@
 * You should have received a copy of the GNU Affero General Public License
 * along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../redismodule.h"
@@ -23,6 +25,7 @@
 #include "../rmutil/strings.h"
 #include "../rmutil/vector.h"
 #include "../rmutil/heap.h"
+#include "../rmutil/hashmap.h"
 
 #define RM_MODULE_NAME "rxzsets"
 
@@ -136,10 +139,52 @@ int MZGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   return REDISMODULE_OK;
 }
 
+/* A member to be added by ZADDCAPPED, with its score. */
+typedef struct {
+  RedisModuleString *ele;
+  const char *str;
+  size_t len;
+  double score;
+  int exists;
+} ZCappedEntry;
+
+/* Compares members in sorted set order: by score, then lexicographically. */
+int zcapped_cmp(const void *a, const void *b) {
+  const ZCappedEntry *e1 = a, *e2 = b;
+  if (e1->score != e2->score) return (e1->score < e2->score ? -1 : 1);
+  int c = memcmp(e1->str, e2->str, (e1->len < e2->len ? e1->len : e2->len));
+  if (c) return c;
+  return (e1->len < e2->len ? -1 : (e1->len > e2->len ? 1 : 0));
+}
+
+int zcapped_revcmp(const void *a, const void *b) { return zcapped_cmp(b, a); }
+
+/* Removes the member at the trimmed end of a sorted set: the highest one, or
+ * the lowest in REV variant. Returns 1 if it was ele. */
+int zcapped_trim(RedisModuleCtx *ctx, RedisModuleKey *key, int rev,
+                 RedisModuleString *ele) {
+  if (rev)
+    RedisModule_ZsetFirstInScoreRange(key, REDISMODULE_NEGATIVE_INFINITE,
+                                      REDISMODULE_POSITIVE_INFINITE, 0, 0);
+  else
+    RedisModule_ZsetLastInScoreRange(key, REDISMODULE_NEGATIVE_INFINITE,
+                                     REDISMODULE_POSITIVE_INFINITE, 0, 0);
+  RedisModuleString *last = RedisModule_ZsetRangeCurrentElement(key, NULL);
+  RedisModule_ZsetRangeStop(key);
+
+  int trimmed = (ele && RMUtil_StringEquals(last, ele));
+  RedisModule_ZsetRem(key, last, NULL);
+  RedisModule_FreeString(ctx, last);
+  return trimmed;
+}
+
 /*
 * ZADDCAPPED | ZADDREVCAPPED zset cap score member [score member ...]
 * Adds members to a sorted set, keeping it at `cap` cardinality. Removes
 * top scoring (or lowest scoring in REV variant) members as needed.
+* Only the members that can survive the cap are actually added: the new
+* members are ordered and added best first, stopping as soon as one is
+* trimmed right away.
 * Reply: Integer, the number of members added.
 */
 int ZAddCappedGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
@@ -171,21 +216,67 @@ int ZAddCappedGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
     RedisModule_ReplyWithError(ctx, "ERR invalid cap");
     return REDISMODULE_ERR;
   }
-  /* Add the memebers. */
-  RedisModuleCallReply *rep =
-      RedisModule_Call(ctx, "ZADD", "sv", argv[1], &argv[3], argc - 3);
-  RMUTIL_ASSERT_NOERROR(rep)
 
-  long long added = RedisModule_CallReplyInteger(rep);
+  /* Parse the members, the last score of a repeated member wins. */
+  size_t n = 0;
+  ZCappedEntry *entries =
+      RedisModule_PoolAlloc(ctx, (argc - 3) / 2 * sizeof(ZCappedEntry));
+  HashMap *seen = NewHashMap((argc - 3) / 2);
+  for (int i = 3; i < argc; i += 2) {
+    double score;
+    if ((RedisModule_StringToDouble(argv[i], &score) != REDISMODULE_OK) ||
+        isnan(score)) {
+      HashMap_Free(seen, NULL);
+      RedisModule_ReplyWithError(ctx, "ERR value is not a valid float");
+      return REDISMODULE_ERR;
+    }
+
+    size_t len;
+    const char *str = RedisModule_StringPtrLen(argv[i + 1], &len);
+    int added;
+    HashMapEntry *e = HashMap_Insert(seen, str, len, &added);
+    if (added) {
+      e->value = &entries[n++];
+      *(ZCappedEntry *)e->value = (ZCappedEntry){argv[i + 1], str, len};
+    }
+    ((ZCappedEntry *)e->value)->score = score;
+  }
+  HashMap_Free(seen, NULL);
+
+  /* Order the new members from the best to the worst. */
+  qsort(entries, n, sizeof(ZCappedEntry), rev ? zcapped_revcmp : zcapped_cmp);
+
+  /* Apply updates of existing members first, as they may open up room.
+   * Members that are beaten by cap new ones would be trimmed anyway. */
+  long long added = 0;
+  for (size_t i = 0; i < n; i++) {
+    double score;
+    entries[i].exists =
+        (RedisModule_ZsetScore(key, entries[i].ele, &score) == REDISMODULE_OK);
+    if (!entries[i].exists)
+      added++;
+    else if (i < cap)
+      RedisModule_ZsetAdd(key, entries[i].score, entries[i].ele, NULL);
+    else
+      RedisModule_ZsetRem(key, entries[i].ele, NULL);
+  }
 
-  /* Trim the right end of the list if reached the cap. */
-  key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+  /* Add the rest, stopping once one doesn't make it: the following ones are
+   * worse. */
   size_t card = RedisModule_ValueLength(key);
-  if (card > cap) {
-    RedisModuleCallReply *rz = RedisModule_Call(
-        ctx, "ZREMRANGEBYRANK", "sll", argv[1], (rev ? 0 : -(card - cap)),
-        (rev ? (card - cap - 1) : -1));
-    RMUTIL_ASSERT_NOERROR(rz)
+  for (size_t i = 0; i < n && i < cap; i++) {
+    if (entries[i].exists) continue;
+    RedisModule_ZsetAdd(key, entries[i].score, entries[i].ele, NULL);
+    if (++card > cap) {
+      card--;
+      if (zcapped_trim(ctx, key, rev, entries[i].ele)) break;
+    }
+  }
+
+  /* Trim the set if it was already over the cap. */
+  while (card > cap) {
+    zcapped_trim(ctx, key, rev, NULL);
+    card--;
   }
 
   RedisModule_ReplyWithLongLong(ctx, added);
@@ -193,42 +284,88 @@ int ZAddCappedGenericCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
   return REDISMODULE_OK;
 }
 
+/* A sorted set read by ZUNIONTOP, from its best weighted score down. */
 typedef struct {
-    RedisModuleKey *key;
-    RedisModuleString *element;
-    double score;
-    double weight;
-} ZsetEntry;
-
-int __zsetentry_less(void *e1, void *e2) {
-  ZsetEntry *__e1 = (ZsetEntry *) e1;
-  ZsetEntry *__e2 = (ZsetEntry *) e2;
-  double x = __e1->score * __e1->weight - __e2->score * __e2->weight;
-  return x < 0 ? -1 : (x > 0 ? 1 : 0);
+  RedisModuleKey *key;
+  double weight;
+  int desc;                /* whether it is read from its highest score */
+  int done;
+  RedisModuleString *ele;  /* the next member to read */
+  double score;            /* and its weighted score */
+} ZUnionSource;
+
+/* A member of the union, with its aggregated score. */
+typedef struct {
+  RedisModuleString *ele;
+  const char *str;
+  size_t len;
+  double score;
+} ZUnionEntry;
+
+#define ZUNION_SUM 0
+#define ZUNION_MIN 1
+#define ZUNION_MAX 2
+
+/* Compares members in sorted set order: by score, then lexicographically. */
+int zunion_cmp(void *a, void *b) {
+  ZUnionEntry *e1 = a, *e2 = b;
+  if (e1->score != e2->score) return (e1->score < e2->score ? -1 : 1);
+  int c = memcmp(e1->str, e2->str, (e1->len < e2->len ? e1->len : e2->len));
+  if (c) return c;
+  return (e1->len < e2->len ? -1 : (e1->len > e2->len ? 1 : 0));
+}
+
+int zunion_revcmp(void *a, void *b) { return zunion_cmp(b, a); }
+
+/* Weights and aggregates scores the way ZUNIONSTORE does, NaNs become 0. */
+double zunion_weighted(double weight, double score) {
+  double x = weight * score;
+  return (isnan(x) ? 0 : x);
 }
 
-int __zsetentry_greater(void *e1, void *e2) {
-  ZsetEntry *__e1 = (ZsetEntry *) e1;
-  ZsetEntry *__e2 = (ZsetEntry *) e2;
-  double x = __e1->score * __e1->weight - __e2->score * __e2->weight;
-  return x < 0 ? 1 : (x > 0 ? -1 : 0);
+double zunion_aggregate(int op, double a, double b) {
+  if (op == ZUNION_MIN) return (a < b ? a : b);
+  if (op == ZUNION_MAX) return (a > b ? a : b);
+  double x = a + b;
+  return (isnan(x) ? 0 : x);
+}
+
+/* Reads the member a source's iterator is at, or marks the source done. */
+void zunion_read(ZUnionSource *s) {
+  if (RedisModule_ZsetRangeEndReached(s->key)) {
+    RedisModule_ZsetRangeStop(s->key);
+    s->done = 1;
+    return;
+  }
+  double score;
+  s->ele = RedisModule_ZsetRangeCurrentElement(s->key, &score);
+  s->score = zunion_weighted(s->weight, score);
 }
 
 /*
-* ZUNIONTOP | ZUNIONREVTOP k numkeys key [key ...] [WEIGHTS weight [weight ...]] [WITHSCORES]
+* ZUNIONTOP | ZUNIONREVTOP k numkeys key [key ...]
+*   [WEIGHTS weight [weight ...]] [AGGREGATE SUM|MIN|MAX] [WITHSCORES]
 * Union multiple sorted sets with top K elements returned.
-* Reply: Array reply, the top k elements (optionally with the score, in case the 'WITHSCORES' option is given).
+* The sets are read round-robin in their weighted score order, and each member
+* read for the first time gets its score in the other sets looked up, so its
+* aggregate is final right away. Members not read yet can't aggregate to a
+* better score than the sets' next scores allow, so reading stops as soon as
+* the K best aggregates beat that threshold (Fagin's threshold algorithm).
+* Reply: Array reply, the top k elements (optionally with the score, in case
+* the 'WITHSCORES' option is given).
 */
-int ZUnionTopKCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+int ZUnionTopKCommand(RedisModuleCtx *ctx, RedisModuleString **argv,
+                      int argc) {
   if (argc < 4) {
     /* TODO: handle this once the getkey-api allows signalling errors */
-    return RedisModule_IsKeysPositionRequest(ctx) ? REDISMODULE_OK : RedisModule_WrongArity(ctx);
+    return RedisModule_IsKeysPositionRequest(ctx) ? REDISMODULE_OK
+                                                  : RedisModule_WrongArity(ctx);
   }
 
   RedisModule_AutoMemory(ctx);
-  int rev = !strcasecmp("zunionrevtop", RedisModule_StringPtrLen(argv[0], NULL));
-  int (*ZsetScoreRange)(RedisModuleKey*, double, double, int, int) =
-          rev ? RedisModule_ZsetLastInScoreRange : RedisModule_ZsetFirstInScoreRange;
+  int rev =
+      !strcasecmp("zunionrevtop", RedisModule_StringPtrLen(argv[0], NULL));
+  int (*cmp)(void *, void *) = rev ? zunion_revcmp : zunion_cmp;
 
   long long k;
   if (RedisModule_StringToLongLong(argv[1], &k) != REDISMODULE_OK || k < 1) {
@@ -237,31 +374,16 @@ int ZUnionTopKCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   }
 
   long long numkeys;
-  if (RedisModule_StringToLongLong(argv[2], &numkeys) != REDISMODULE_OK || numkeys < 1) {
+  if (RedisModule_StringToLongLong(argv[2], &numkeys) != REDISMODULE_OK ||
+      numkeys < 1) {
     RedisModule_ReplyWithError(ctx, "ERR invalid numkeys");
     return REDISMODULE_ERR;
   }
 
-  int has_weights = 0, with_scores = 0;
   if (argc < 3 + numkeys) {
     /* TODO: handle this once the getkey-api allows signalling errors */
-    return RedisModule_IsKeysPositionRequest(ctx) ? REDISMODULE_OK : RedisModule_WrongArity(ctx);
-  } else if (argc > 3 + numkeys) {
-    has_weights = !strcasecmp("weights", RedisModule_StringPtrLen(argv[3 + numkeys], NULL));
-    with_scores = !strcasecmp("withscores", RedisModule_StringPtrLen(argv[argc - 1], NULL));
-  }
-
-  // validate argc
-  if (has_weights) {
-    if (argc != 4 + 2 * numkeys + with_scores) {
-      /* TODO: handle this once the getkey-api allows signalling errors */
-      return RedisModule_IsKeysPositionRequest(ctx) ? REDISMODULE_OK : RedisModule_WrongArity(ctx);
-    }
-  } else {
-    if (argc != 3 + numkeys + with_scores) {
-      /* TODO: handle this once the getkey-api allows signalling errors */
-      return RedisModule_IsKeysPositionRequest(ctx) ? REDISMODULE_OK : RedisModule_WrongArity(ctx);
-    }
+    return RedisModule_IsKeysPositionRequest(ctx) ? REDISMODULE_OK
+                                                  : RedisModule_WrongArity(ctx);
   }
 
   if (RedisModule_IsKeysPositionRequest(ctx)) {
@@ -271,63 +393,151 @@ int ZUnionTopKCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
     return REDISMODULE_OK;
   }
 
-  Vector *v = NewVector(ZsetEntry, numkeys);
-  for (size_t i = 0; i < numkeys; i++) {
-    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[3 + i], REDISMODULE_READ);
-    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_ZSET) {
-      if (RedisModule_ValueLength(key) == 0) {
-        continue;
+  /* Parse the options. */
+  double *weights = RedisModule_PoolAlloc(ctx, numkeys * sizeof(double));
+  for (int i = 0; i < numkeys; i++) weights[i] = 1;
+  int op = ZUNION_SUM, with_scores = 0;
+  for (int j = 3 + numkeys; j < argc; j++) {
+    const char *opt = RedisModule_StringPtrLen(argv[j], NULL);
+    if (!strcasecmp("weights", opt) && j + numkeys < argc) {
+      for (int i = 0; i < numkeys; i++) {
+        if (RedisModule_StringToDouble(argv[++j], &weights[i]) !=
+                REDISMODULE_OK ||
+            isnan(weights[i])) {
+          RedisModule_ReplyWithError(ctx, "ERR invalid weight");
+          return REDISMODULE_ERR;
+        }
       }
-      ZsetScoreRange(key, REDISMODULE_NEGATIVE_INFINITE, REDISMODULE_POSITIVE_INFINITE, 0, 0);
-      ZsetEntry entry;
-      entry.key = key;
-      entry.element = RedisModule_ZsetRangeCurrentElement(key, &entry.score);
-      entry.weight = 1;
-      __vector_PushPtr(v, &entry);
-    } else if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
-      continue;
+    } else if (!strcasecmp("aggregate", opt) && j + 1 < argc) {
+      const char *agg = RedisModule_StringPtrLen(argv[++j], NULL);
+      if (!strcasecmp("sum", agg)) {
+        op = ZUNION_SUM;
+      } else if (!strcasecmp("min", agg)) {
+        op = ZUNION_MIN;
+      } else if (!strcasecmp("max", agg)) {
+        op = ZUNION_MAX;
+      } else {
+        RedisModule_ReplyWithError(ctx, "ERR syntax error");
+        return REDISMODULE_ERR;
+      }
+    } else if (!strcasecmp("withscores", opt)) {
+      with_scores = 1;
     } else {
+      RedisModule_ReplyWithError(ctx, "ERR syntax error");
+      return REDISMODULE_ERR;
+    }
+  }
+
+  /* Open the sets, each at its best weighted score: a negative weight turns
+   * the set's order around. */
+  ZUnionSource *srcs =
+      RedisModule_PoolAlloc(ctx, numkeys * sizeof(ZUnionSource));
+  size_t nsrcs = 0;
+  for (int i = 0; i < numkeys; i++) {
+    RedisModuleKey *key =
+        RedisModule_OpenKey(ctx, argv[3 + i], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) continue;
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_ZSET) {
       RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-      Vector_Free(v);
       return REDISMODULE_ERR;
     }
+
+    ZUnionSource *s = &srcs[nsrcs++];
+    s->key = key;
+    s->weight = weights[i];
+    s->desc = (rev ? weights[i] > 0 : weights[i] < 0);
+    s->done = 0;
+    if (s->desc)
+      RedisModule_ZsetLastInScoreRange(key, REDISMODULE_NEGATIVE_INFINITE,
+                                       REDISMODULE_POSITIVE_INFINITE, 0, 0);
+    else
+      RedisModule_ZsetFirstInScoreRange(key, REDISMODULE_NEGATIVE_INFINITE,
+                                        REDISMODULE_POSITIVE_INFINITE, 0, 0);
+    zunion_read(s);
   }
-  if (has_weights) {
-    for (size_t i = 0; i < numkeys; i++) {
-      ZsetEntry *entry = (ZsetEntry *) (v->data + i * v->elemSize);
-      if (RedisModule_StringToDouble(argv[4 + numkeys + i], &entry->weight) != REDISMODULE_OK) {
-        RedisModule_ReplyWithError(ctx, "ERR invalid weight");
-        Vector_Free(v);
-        return REDISMODULE_ERR;
+
+  /* The K best members found so far, in a heap with the worst on top. */
+  Vector *top = NewVector(ZUnionEntry, (k < 128 ? k : 128));
+  HashMap *seen = NewHashMap(k < 1024 ? k : 1024);
+  for (;;) {
+    for (size_t i = 0; i < nsrcs; i++) {
+      ZUnionSource *s = &srcs[i];
+      if (s->done) continue;
+
+      size_t len;
+      const char *str = RedisModule_StringPtrLen(s->ele, &len);
+      int added;
+      HashMap_Insert(seen, str, len, &added);
+      if (added) {
+        ZUnionEntry e = {s->ele, str, len, s->score};
+        for (size_t j = 0; j < nsrcs; j++) {
+          double score;
+          if ((j != i) && (RedisModule_ZsetScore(srcs[j].key, s->ele,
+                                                 &score) == REDISMODULE_OK))
+            e.score = zunion_aggregate(
+                op, e.score, zunion_weighted(srcs[j].weight, score));
+        }
+        if (top->top < k) {
+          __vector_PushPtr(top, &e);
+          Heap_Push(top, 0, top->top, cmp);
+        } else if (cmp(&e, top->data) < 0) {
+          Heap_Pop(top, 0, top->top, cmp);
+          ZUnionEntry *worst =
+              (ZUnionEntry *)(top->data + (top->top - 1) * top->elemSize);
+          RedisModule_FreeString(ctx, worst->ele);
+          *worst = e;
+          Heap_Push(top, 0, top->top, cmp);
+        } else {
+          RedisModule_FreeString(ctx, s->ele);
+        }
+      } else {
+        RedisModule_FreeString(ctx, s->ele);
+      }
+
+      if ((s->desc ? RedisModule_ZsetRangePrev(s->key)
+                   : RedisModule_ZsetRangeNext(s->key)) == 0) {
+        RedisModule_ZsetRangeStop(s->key);
+        s->done = 1;
+      } else {
+        zunion_read(s);
       }
     }
-  }
-  Make_Heap(v, 0, v->top, rev ? __zsetentry_less : __zsetentry_greater);
-
-  size_t reply_count = 0;
-  RedisModule_ReplyWithArray(ctx, REDISMODULE_POSTPONED_ARRAY_LEN);
-  for (size_t i = 0; i < k && v->top != 0; i++) {
-    // pop from heap
-    Heap_Pop(v, 0, v->top, rev ? __zsetentry_less : __zsetentry_greater);
-    ZsetEntry *entry = (ZsetEntry *) (v->data + ((v->top - 1) * v->elemSize));
-    // reply to client
-    RedisModule_ReplyWithString(ctx, entry->element);
-    reply_count++;
-    if (with_scores) {
-      RedisModule_ReplyWithDouble(ctx, entry->score * entry->weight);
-      reply_count++;
+
+    /* The threshold: a member that wasn't read yet has a score no better
+     * than the next one in each set it's in. Its best aggregate is the best
+     * of these, or for SUM the total of the ones that improve a sum. Scores
+     * are negated for ZUNIONREVTOP so that lower is always better. */
+    int active = 0;
+    double best = 0, gains = 0;
+    for (size_t i = 0; i < nsrcs; i++) {
+      if (srcs[i].done) continue;
+      double x = (rev ? -srcs[i].score : srcs[i].score);
+      if (!active || x < best) best = x;
+      if (x < 0) gains += x;
+      active = 1;
     }
-    // get the next element
-    if ((rev ? RedisModule_ZsetRangePrev(entry->key) : RedisModule_ZsetRangeNext(entry->key)) == 0) {
-      RedisModule_ZsetRangeStop(entry->key);
-      v->top--;
-    } else {
-      entry->element = RedisModule_ZsetRangeCurrentElement(entry->key, &entry->score);
-      Heap_Push(v, 0, v->top, rev ? __zsetentry_less : __zsetentry_greater);
+    if (!active) break;
+    double threshold = ((op == ZUNION_SUM && gains < 0) ? gains : best);
+    if (top->top == k) {
+      double worst = ((ZUnionEntry *)top->data)->score;
+      if ((rev ? -worst : worst) < threshold) break;
     }
   }
-  RedisModule_ReplySetArrayLength(ctx, reply_count);
-  Vector_Free(v);
+  HashMap_Free(seen, NULL);
+  for (size_t i = 0; i < nsrcs; i++) {
+    if (!srcs[i].done) RedisModule_ZsetRangeStop(srcs[i].key);
+  }
+
+  /* Sort the heap, best first. */
+  for (size_t n = top->top; n > 1; n--) Heap_Pop(top, 0, n, cmp);
+
+  RedisModule_ReplyWithArray(ctx, top->top * (with_scores ? 2 : 1));
+  for (size_t i = 0; i < top->top; i++) {
+    ZUnionEntry *e = (ZUnionEntry *)(top->data + i * top->elemSize);
+    RedisModule_ReplyWithString(ctx, e->ele);
+    if (with_scores) RedisModule_ReplyWithDouble(ctx, e->score);
+  }
+  Vector_Free(top);
 
   return REDISMODULE_OK;
 }
@@ -406,6 +616,66 @@ int testZAddCapped(RedisModuleCtx *ctx) {
   RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
   RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "2");
   RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "foo");
+  r = RedisModule_Call(ctx, "zaddcapped", "cccccccccc", "zset", "3", "0", "a",
+                       "10", "2", "9", "b", "0.5", "c");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 3);
+  r = RedisModule_Call(ctx, "ZRANGE", "ccc", "zset", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 3);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "c");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "1");
+  r = RedisModule_Call(ctx, "zaddrevcapped", "cccccc", "zset", "2", "5", "x",
+                       "-1", "y");
+  RMUtil_Assert(RedisModule_CallReplyInteger(r) == 2);
+  r = RedisModule_Call(ctx, "ZRANGE", "ccc", "zset", "0", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "1");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "x");
+
+  r = RedisModule_Call(ctx, "FLUSHALL", "");
+
+  return 0;
+}
+
+int testZUnionTop(RedisModuleCtx *ctx) {
+  RedisModuleCallReply *r;
+
+  r = RedisModule_Call(ctx, "ZADD", "ccccccc", "z1", "1", "a", "2", "b", "3",
+                       "c");
+  r = RedisModule_Call(ctx, "ZADD", "ccccccc", "z2", "10", "a", "1", "b",
+                       "0.5", "d");
+  r = RedisModule_Call(ctx, "zuniontop", "ccccc", "3", "2", "z1", "z2",
+                       "withscores");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 6);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "d");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "0.5");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 2), "b");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 3), "3");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 4), "c");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 5), "3");
+  r = RedisModule_Call(ctx, "zunionrevtop", "ccccc", "1", "2", "z1", "z2",
+                       "withscores");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "11");
+  r = RedisModule_Call(ctx, "zuniontop", "cccccc", "2", "2", "z1", "z2",
+                       "aggregate", "min");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "d");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "a");
+  r = RedisModule_Call(ctx, "zunionrevtop", "cccccc", "2", "2", "z1", "z2",
+                       "aggregate", "max");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "c");
+  r = RedisModule_Call(ctx, "zuniontop", "ccccccccc", "2", "3", "z1",
+                       "nosuchkey", "z2", "weights", "1", "1", "-1");
+  RMUtil_Assert(RedisModule_CallReplyLength(r) == 2);
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 0), "a");
+  RMUtil_AssertReplyEquals(RedisModule_CallReplyArrayElement(r, 1), "d");
+  r = RedisModule_Call(ctx, "zuniontop", "cccccc", "2", "2", "z1", "z2",
+                       "aggregate", "avg");
+  RMUtil_Assert(RedisModule_CallReplyType(r) == REDISMODULE_REPLY_ERROR);
 
   r = RedisModule_Call(ctx, "FLUSHALL", "");
 
@@ -427,6 +697,7 @@ int TestModule(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
   RMUtil_Test(testMZRank);
   RMUtil_Test(testMZScore);
   RMUtil_Test(testZAddCapped);
+  RMUtil_Test(testZUnionTop);
 
   RedisModule_ReplyWithSimpleString(ctx, "PASS");
   return REDISMODULE_OK;